@@ -1,20 +1,29 @@
 #pragma once
 
 #include "task.hh"
+#include "future.hh"
 #include <future>
 #include <optional>
 
 // Returns a continuation function that stores the result of the task in the given future.
 template <typename T>
+auto store_in(Future<T> & future);
+template <typename T>
 auto store_in(std::future<T> & future);
 
 // Launches a task in an executor and returns a future that will hold the result of the task.
 template <is_task_executor TaskExecutor, is_task T>
-auto async(TaskExecutor & executor, Continuable<T> t) -> std::future<task_result_type<T>>;
+auto async(TaskExecutor & executor, Continuable<T> t) -> Future<task_result_type<T>>;
+template <is_prioritized_task_executor TaskExecutor, is_task T>
+auto async(TaskExecutor & executor, Continuable<T> t, TaskPriority priority) -> Future<task_result_type<T>>;
 
+template <typename T>
+auto is_ready(Future<T> const & future) -> bool;
 template <typename T>
 auto is_ready(std::future<T> const & future) -> bool;
 
+template <typename T>
+auto get_if_ready(Future<T> & future) -> std::optional<T>;
 template <typename T>
 auto get_if_ready(std::future<T> & future) -> std::optional<T>;
 
@@ -1,3 +1,14 @@
+template <typename T>
+auto store_in(Future<T> & future)
+{
+	Promise<T> promise;
+	future = promise.get_future();
+	return[promise_ = std::move(promise)](T t) mutable
+	{
+		promise_.set_value(std::move(t));
+	};
+}
+
 template <typename T>
 auto store_in(std::future<T> & future)
 {
@@ -10,19 +21,42 @@ auto store_in(std::future<T> & future)
 }
 
 template <is_task_executor TaskExecutor, is_task T>
-auto async(TaskExecutor & executor, Continuable<T> t) -> std::future<task_result_type<T>>
+auto async(TaskExecutor & executor, Continuable<T> t) -> Future<task_result_type<T>>
 {
-	std::future<task_result_type<T>> future;
+	Future<task_result_type<T>> future;
 	executor.run_task(std::move(t).then(store_in(future)));
 	return future;
 }
 
+template <is_prioritized_task_executor TaskExecutor, is_task T>
+auto async(TaskExecutor & executor, Continuable<T> t, TaskPriority priority) -> Future<task_result_type<T>>
+{
+	Future<task_result_type<T>> future;
+	executor.run_task(std::move(t).then(store_in(future)), priority);
+	return future;
+}
+
+template <typename T>
+auto is_ready(Future<T> const & future) -> bool
+{
+	return future.is_ready();
+}
+
 template <typename T>
 auto is_ready(std::future<T> const & future) -> bool
 {
 	return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
 }
 
+template <typename T>
+auto get_if_ready(Future<T> & future) -> std::optional<T>
+{
+	if (is_ready(future))
+		return future.get();
+	else
+		return std::nullopt;
+}
+
 template <typename T>
 auto get_if_ready(std::future<T> & future) -> std::optional<T>
 {
@@ -0,0 +1,124 @@
+#include "bounded_task_queue.hh"
+#include <bit>
+#include <algorithm>
+#include <thread>
+
+// With a single slot the sequence number of a full slot and of a free slot in the next lap would
+// be the same.
+static auto actual_capacity(size_t requested_capacity) noexcept -> size_t
+{
+	return std::bit_ceil(std::max<size_t>(requested_capacity, 2));
+}
+
+BoundedTaskQueue::BoundedTaskQueue(size_t capacity_)
+	: slots(std::make_unique<Slot[]>(actual_capacity(capacity_)))
+	, mask(actual_capacity(capacity_) - 1)
+{
+	for (size_t i = 0; i <= mask; ++i)
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+auto BoundedTaskQueue::try_push(PolymorphicTask && task) -> bool
+{
+	size_t position = enqueue_position.load(std::memory_order_relaxed);
+	Slot * slot;
+	while (true)
+	{
+		slot = &slots[position & mask];
+		size_t const sequence = slot->sequence.load(std::memory_order_acquire);
+		auto const difference = static_cast<std::ptrdiff_t>(sequence - position);
+
+		if (difference == 0) // Slot is free. Try to claim it.
+		{
+			if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0) // Slot still holds the task of the previous lap. Queue is full.
+			return false;
+		else // Another producer claimed it first.
+			position = enqueue_position.load(std::memory_order_relaxed);
+	}
+
+	slot->task = std::move(task);
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+auto BoundedTaskQueue::pop_task() -> std::optional<PolymorphicTask>
+{
+	size_t position = dequeue_position.load(std::memory_order_relaxed);
+	Slot * slot;
+	while (true)
+	{
+		slot = &slots[position & mask];
+		size_t const sequence = slot->sequence.load(std::memory_order_acquire);
+		auto const difference = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+
+		if (difference == 0) // Slot has a task. Try to claim it.
+		{
+			if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0) // Slot hasn't been written yet. Queue is empty.
+			return std::nullopt;
+		else // Another consumer claimed it first.
+			position = dequeue_position.load(std::memory_order_relaxed);
+	}
+
+	auto task = std::move(slot->task);
+	// Hand the slot over to the producer of the next lap.
+	slot->sequence.store(position + mask + 1, std::memory_order_release);
+	return task;
+}
+
+// Tasks run while helping may push in turn. Bounds how deep that goes on the stack.
+static constexpr int max_help_depth = 4;
+static thread_local int help_depth = 0;
+
+auto BoundedTaskQueue::run_task(PolymorphicTask task) -> void
+{
+	while (!try_push(std::move(task)))
+	{
+		if (help_depth < max_help_depth)
+		{
+			struct HelpScope
+			{
+				HelpScope() { ++help_depth; }
+				~HelpScope() { --help_depth; }
+			};
+			auto const scope = HelpScope();
+			if (this_thread::perform_task_for(*this))
+				continue;
+		}
+		std::this_thread::yield();
+	}
+}
+
+auto BoundedTaskQueue::number_of_queued_tasks() const noexcept -> int
+{
+	size_t const dequeued = dequeue_position.load(std::memory_order_relaxed);
+	size_t const enqueued = enqueue_position.load(std::memory_order_relaxed);
+	return enqueued > dequeued ? static_cast<int>(enqueued - dequeued) : 0;
+}
+
+namespace this_thread
+{
+	auto perform_task_for(BoundedTaskQueue & task_queue) -> bool
+	{
+		auto task = task_queue.pop_task();
+		if (task)
+		{
+			task->consume();
+			return true;
+		}
+		else return false;
+	}
+
+	auto work_until_no_tasks_left_for(BoundedTaskQueue & task_queue) -> int
+	{
+		int tasks_done = 0;
+		while (perform_task_for(task_queue))
+			tasks_done++;
+		return tasks_done;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "polymorphic_task.hh"
+#include "cache_line.hh"
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <span>
+#include <cstddef>
+
+// Multi producer multi consumer queue with a fixed capacity. It is a ring of preallocated slots, each
+// with a sequence number that tells producers and consumers whose turn it is to use it (Dmitry
+// Vyukov's bounded queue), so pushing and popping are lock free and never allocate. When the queue
+// is full pushing fails instead of growing, which lets producers apply backpressure.
+struct BoundedTaskQueue
+{
+	// Capacity is rounded up to a power of two, and is at least 2.
+	explicit BoundedTaskQueue(size_t capacity);
+
+	// Returns false if the queue is full, in which case task is left untouched.
+	[[nodiscard]] auto try_push(PolymorphicTask && task) -> bool;
+	auto pop_task() -> std::optional<PolymorphicTask>;
+
+	// To make it satisfy the executor concept. If the queue is full, waits for room and helps make
+	// some by running the oldest queued task, so tasks still run in the order they were pushed. Only a
+	// few calls deep on the same thread help, deeper ones just yield until another thread pops.
+	auto run_task(PolymorphicTask task) -> void;
+
+	auto capacity() const noexcept -> size_t { return mask + 1; }
+	// Approximate if there are other threads pushing or popping at the same time.
+	auto number_of_queued_tasks() const noexcept -> int;
+	auto has_work_queued() const noexcept -> bool { return number_of_queued_tasks() > 0; }
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		PolymorphicTask task;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	size_t mask;
+
+	alignas(cache_line_size) std::atomic<size_t> enqueue_position = 0;
+	alignas(cache_line_size) std::atomic<size_t> dequeue_position = 0;
+};
+
+inline auto as_work_source(BoundedTaskQueue & queue);
+
+namespace this_thread
+{
+	auto perform_task_for(BoundedTaskQueue & task_queue) -> bool;
+	auto work_until_no_tasks_left_for(BoundedTaskQueue & task_queue) -> int;
+}
+
+#include "bounded_task_queue.inl"
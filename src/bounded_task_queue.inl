@@ -0,0 +1,16 @@
+inline auto as_work_source(BoundedTaskQueue & queue)
+{
+	return [&queue](std::span<PolymorphicTask> batch)
+	{
+		int popped = 0;
+		for (PolymorphicTask & slot : batch)
+		{
+			auto task = queue.pop_task();
+			if (!task)
+				break;
+			slot = std::move(*task);
+			popped++;
+		}
+		return popped;
+	};
+}
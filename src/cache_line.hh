@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+// Data written by different threads is kept this far apart so that the threads don't false share.
+constexpr size_t cache_line_size = 64;
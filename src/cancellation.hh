@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// Read side of a cancellation flag. Copies share the flag with the source they came from. A default
+// constructed token can never be cancelled.
+struct CancellationToken
+{
+	CancellationToken() noexcept = default;
+
+	auto is_cancelled() const noexcept -> bool { return state && state->load(std::memory_order_relaxed); }
+	auto can_be_cancelled() const noexcept -> bool { return state != nullptr; }
+
+private:
+	friend struct CancellationSource;
+	explicit CancellationToken(std::shared_ptr<std::atomic<bool> const> state_) noexcept : state(std::move(state_)) {}
+
+	std::shared_ptr<std::atomic<bool> const> state;
+};
+
+// Cancellation is cooperative. Chains check their token when they are about to schedule a task and
+// drop themselves if it is cancelled, but a task that is already running runs to completion.
+struct CancellationSource
+{
+	CancellationSource() : state(std::make_shared<std::atomic<bool>>(false)) {}
+
+	auto cancel() noexcept -> void { state->store(true, std::memory_order_relaxed); }
+	auto is_cancelled() const noexcept -> bool { return state->load(std::memory_order_relaxed); }
+	auto token() const noexcept -> CancellationToken { return CancellationToken(state); }
+
+private:
+	std::shared_ptr<std::atomic<bool>> state;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "task.hh"
+#include "async.hh"
+#include <coroutine>
+#include <exception>
+#include <optional>
+
+// Lazily started coroutine that produces a T. It starts running when it is awaited, and the awaiting
+// coroutine is resumed right where it ends, on the same thread, without going through any executor.
+// Where it runs is chosen inside it with co_await schedule_on(executor).
+template <typename T = void>
+struct CoTask;
+
+namespace detail
+{
+	// Resumes a coroutine when run as a task. A single pointer, so it always fits in the small buffer
+	// of a PolymorphicTask.
+	struct ResumeCoroutine
+	{
+		auto operator () () const -> void { handle.resume(); }
+
+		std::coroutine_handle<> handle;
+	};
+	static_assert(sizeof(ResumeCoroutine) == sizeof(void *));
+
+	struct CoTaskPromiseBase
+	{
+		struct FinalAwaiter
+		{
+			auto await_ready() const noexcept -> bool { return false; }
+			template <typename Promise>
+			auto await_suspend(std::coroutine_handle<Promise> handle) const noexcept -> std::coroutine_handle<> { return handle.promise().continuation; }
+			auto await_resume() const noexcept -> void {}
+		};
+
+		auto initial_suspend() const noexcept -> std::suspend_always { return {}; }
+		auto final_suspend() const noexcept -> FinalAwaiter { return {}; }
+		auto unhandled_exception() noexcept -> void { exception = std::current_exception(); }
+
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+		std::exception_ptr exception;
+	};
+
+	template <typename T>
+	struct CoTaskPromise : CoTaskPromiseBase
+	{
+		auto get_return_object() noexcept -> CoTask<T>;
+		auto return_value(T value) -> void { result.emplace(std::move(value)); }
+		auto take_result() -> T;
+
+		std::optional<T> result;
+	};
+
+	template <>
+	struct CoTaskPromise<void> : CoTaskPromiseBase
+	{
+		auto get_return_object() noexcept -> CoTask<void>;
+		auto return_void() const noexcept -> void {}
+		auto take_result() -> void;
+	};
+
+	template <is_task_executor Executor>
+	struct ScheduleOn
+	{
+		auto await_ready() const noexcept -> bool { return false; }
+		auto await_suspend(std::coroutine_handle<> handle) const -> void { executor->run_task(ResumeCoroutine{handle}); }
+		auto await_resume() const noexcept -> void {}
+
+		Executor * executor;
+	};
+
+	template <typename FutureType, is_task_executor Executor>
+	struct ResumeWhenReady;
+
+	// Resumed by a callback of the future.
+	template <typename T, is_task_executor Executor>
+	struct ResumeWhenReady<Future<T>, Executor>
+	{
+		auto await_ready() const -> bool { return future->is_ready(); }
+		auto await_suspend(std::coroutine_handle<> handle) const -> void;
+		auto await_resume() const { return future->get(); }
+
+		Future<T> * future;
+		Executor * executor;
+	};
+
+	// std::future can't call anyone back, so it is polled by a task.
+	template <typename T, is_task_executor Executor>
+	struct ResumeWhenReady<std::future<T>, Executor>
+	{
+		auto await_ready() const -> bool { return is_ready(*future); }
+		auto await_suspend(std::coroutine_handle<> handle) const -> void;
+		auto await_resume() const { return future->get(); }
+
+		std::future<T> * future;
+		Executor * executor;
+	};
+} // namespace detail
+
+template <typename T>
+struct [[nodiscard]] CoTask
+{
+	using promise_type = detail::CoTaskPromise<T>;
+	using result_type = T;
+
+	explicit CoTask(std::coroutine_handle<promise_type> handle_) noexcept : handle(handle_) {}
+
+	CoTask(CoTask const &) = delete;
+	CoTask & operator = (CoTask const &) = delete;
+
+	CoTask(CoTask && other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	CoTask & operator = (CoTask && other) noexcept;
+
+	~CoTask();
+
+	auto operator co_await() && noexcept;
+
+private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+// Moves the awaiting coroutine to the executor. Resumption is a task that holds only the coroutine
+// handle, so it never allocates.
+template <is_task_executor Executor>
+[[nodiscard]] auto schedule_on(Executor & executor) noexcept -> detail::ScheduleOn<Executor>;
+
+// Suspends the awaiting coroutine until the future is ready and resumes it on the executor with the
+// result. A Future pushes the resumption to the executor when its result is set. A std::future can't,
+// so while it isn't ready a task that checks it is pushed to the executor over and over, with low
+// priority if the executor has priorities so that the work it waits for goes first.
+template <typename T, is_task_executor Executor>
+[[nodiscard]] auto resume_when_ready(Future<T> & future, Executor & executor) noexcept -> detail::ResumeWhenReady<Future<T>, Executor>;
+template <typename T, is_task_executor Executor>
+[[nodiscard]] auto resume_when_ready(std::future<T> & future, Executor & executor) noexcept -> detail::ResumeWhenReady<std::future<T>, Executor>;
+
+// Starts running the coroutine on the executor and returns a future that will hold its result.
+template <is_task_executor TaskExecutor, typename T>
+auto async(TaskExecutor & executor, CoTask<T> t) -> Future<T>;
+
+#include "co_task.inl"
@@ -0,0 +1,157 @@
+namespace detail
+{
+	template <typename T>
+	auto CoTaskPromise<T>::get_return_object() noexcept -> CoTask<T>
+	{
+		return CoTask<T>(std::coroutine_handle<CoTaskPromise<T>>::from_promise(*this));
+	}
+
+	template <typename T>
+	auto CoTaskPromise<T>::take_result() -> T
+	{
+		if (exception)
+			std::rethrow_exception(exception);
+		return std::move(*result);
+	}
+
+	inline auto CoTaskPromise<void>::get_return_object() noexcept -> CoTask<void>
+	{
+		return CoTask<void>(std::coroutine_handle<CoTaskPromise<void>>::from_promise(*this));
+	}
+
+	inline auto CoTaskPromise<void>::take_result() -> void
+	{
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+
+	template <typename T>
+	struct CoTaskAwaiter
+	{
+		auto await_ready() const noexcept -> bool { return false; }
+		auto await_suspend(std::coroutine_handle<> awaiting) const noexcept -> std::coroutine_handle<>
+		{
+			handle.promise().continuation = awaiting;
+			return handle;
+		}
+		auto await_resume() const -> T { return handle.promise().take_result(); }
+
+		std::coroutine_handle<CoTaskPromise<T>> handle;
+	};
+
+	template <typename T, is_task_executor Executor>
+	auto ResumeWhenReady<Future<T>, Executor>::await_suspend(std::coroutine_handle<> handle) const -> void
+	{
+		// May run right here, or on another thread before this returns, so nothing of this awaiter can
+		// be touched after it.
+		future->on_ready([executor_ = executor, handle]() { executor_->run_task(ResumeCoroutine{handle}); });
+	}
+
+	template <typename T, is_task_executor Executor>
+	auto ResumeWhenReady<std::future<T>, Executor>::await_suspend(std::coroutine_handle<> handle) const -> void
+	{
+		struct Poll
+		{
+			auto operator () () const -> void
+			{
+				if (is_ready(*future))
+					handle.resume();
+				else if constexpr (is_prioritized_task_executor<Executor>)
+					executor->run_task(*this, TaskPriority::low);
+				else
+					executor->run_task(*this);
+			}
+
+			std::future<T> * future;
+			Executor * executor;
+			std::coroutine_handle<> handle;
+		};
+		executor->run_task(Poll{future, executor, handle});
+	}
+
+	// Owns itself, destroys its frame when it finishes.
+	struct DetachedCoroutine
+	{
+		struct promise_type
+		{
+			auto get_return_object() noexcept -> DetachedCoroutine { return DetachedCoroutine{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+			auto initial_suspend() const noexcept -> std::suspend_always { return {}; }
+			auto final_suspend() const noexcept -> std::suspend_never { return {}; }
+			auto return_void() const noexcept -> void {}
+			auto unhandled_exception() const noexcept -> void { std::terminate(); }
+		};
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	template <typename T>
+	auto run_and_store_result(CoTask<T> t, Promise<T> promise) -> DetachedCoroutine
+	{
+		try
+		{
+			if constexpr (std::is_void_v<T>)
+			{
+				co_await std::move(t);
+				promise.set_value();
+			}
+			else
+				promise.set_value(co_await std::move(t));
+		}
+		catch (...)
+		{
+			promise.set_exception(std::current_exception());
+		}
+	}
+} // namespace detail
+
+template <typename T>
+CoTask<T> & CoTask<T>::operator = (CoTask && other) noexcept
+{
+	if (this != &other)
+	{
+		if (handle)
+			handle.destroy();
+		handle = std::exchange(other.handle, nullptr);
+	}
+	return *this;
+}
+
+template <typename T>
+CoTask<T>::~CoTask()
+{
+	if (handle)
+		handle.destroy();
+}
+
+template <typename T>
+auto CoTask<T>::operator co_await() && noexcept
+{
+	return detail::CoTaskAwaiter<T>{handle};
+}
+
+template <is_task_executor Executor>
+auto schedule_on(Executor & executor) noexcept -> detail::ScheduleOn<Executor>
+{
+	return detail::ScheduleOn<Executor>{std::addressof(executor)};
+}
+
+template <typename T, is_task_executor Executor>
+auto resume_when_ready(Future<T> & future, Executor & executor) noexcept -> detail::ResumeWhenReady<Future<T>, Executor>
+{
+	return detail::ResumeWhenReady<Future<T>, Executor>{std::addressof(future), std::addressof(executor)};
+}
+
+template <typename T, is_task_executor Executor>
+auto resume_when_ready(std::future<T> & future, Executor & executor) noexcept -> detail::ResumeWhenReady<std::future<T>, Executor>
+{
+	return detail::ResumeWhenReady<std::future<T>, Executor>{std::addressof(future), std::addressof(executor)};
+}
+
+template <is_task_executor TaskExecutor, typename T>
+auto async(TaskExecutor & executor, CoTask<T> t) -> Future<T>
+{
+	Promise<T> promise;
+	Future<T> future = promise.get_future();
+	executor.run_task(detail::ResumeCoroutine{detail::run_and_store_result(std::move(t), std::move(promise)).handle});
+	return future;
+}
@@ -0,0 +1,155 @@
+#include "elastic_worker_pool.hh"
+#include <cassert>
+
+namespace
+{
+	auto retired_work_source() -> WorkerThread::WorkSource
+	{
+		return [](std::span<PolymorphicTask>)
+		{
+			this_thread::unregister_as_worker();
+			return 0;
+		};
+	}
+
+	// Sleeps until work_for or join unparks the worker.
+	auto retired_idle_strategy() -> IdleStrategy
+	{
+		return IdleStrategy{0, [](Parker & parker) { parker.park(); }};
+	}
+}
+
+ElasticWorkerPool::ElasticWorkerPool(TaskQueue & task_queue_, ElasticWorkerPoolSettings settings_)
+	: task_queue(task_queue_)
+	, settings(settings_)
+{
+	assert(settings.min_workers >= 0);
+	assert(settings.max_workers >= std::max(settings.min_workers, 1));
+	settings.max_workers = std::min(settings.max_workers, task_queue.number_of_queues());
+	settings.min_workers = std::min(settings.min_workers, settings.max_workers);
+
+	worker_count = settings.min_workers;
+	thread_count = settings.min_workers;
+	workers = make_workers_for_queue(task_queue, settings.min_workers);
+
+	monitor_thread = std::thread(&ElasticWorkerPool::monitor, this);
+}
+
+ElasticWorkerPool::~ElasticWorkerPool()
+{
+	{
+		auto const g = std::lock_guard(stop_mutex);
+		stop_requested = true;
+	}
+	stop_condition.notify_one();
+	monitor_thread.join();
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+	for (RetiredWorker & retired : retired_workers)
+		retired.worker.join();
+}
+
+auto ElasticWorkerPool::monitor() -> void
+{
+	auto lock = std::unique_lock(stop_mutex);
+	while (!stop_condition.wait_for(lock, settings.sample_period, [this]() { return stop_requested; }))
+	{
+		lock.unlock();
+		sample();
+		join_old_retired_workers();
+		lock.lock();
+	}
+}
+
+auto ElasticWorkerPool::sample() -> void
+{
+	int const queued = task_queue.number_of_queued_tasks();
+	int const parked = task_queue.number_of_parked_threads();
+
+	// Nobody else can run those.
+	if (has_unowned_pinned_tasks())
+	{
+		samples_wanting_to_shrink = 0;
+		grow();
+	}
+	else if (queued > 0 && parked == 0)
+	{
+		samples_wanting_to_shrink = 0;
+		if (++samples_wanting_to_grow >= settings.samples_to_grow)
+			grow();
+	}
+	else if (queued == 0 && parked > 0)
+	{
+		samples_wanting_to_grow = 0;
+		if (++samples_wanting_to_shrink >= settings.samples_to_shrink)
+			shrink();
+	}
+	else
+	{
+		samples_wanting_to_grow = 0;
+		samples_wanting_to_shrink = 0;
+	}
+}
+
+auto ElasticWorkerPool::grow() -> void
+{
+	samples_wanting_to_grow = 0;
+	if (static_cast<int>(workers.size()) >= settings.max_workers)
+		return;
+
+	// Counted before it starts so that nobody sees a task run by a worker that isn't counted yet.
+	++worker_count;
+	int const queue_index = static_cast<int>(workers.size());
+	if (retired_workers.empty())
+	{
+		++thread_count;
+		workers.emplace_back(as_work_source(task_queue, queue_index), as_idle_strategy(task_queue));
+	}
+	else
+	{
+		// The most recently retired is the least likely to have been swapped out.
+		workers.push_back(std::move(retired_workers.back().worker));
+		retired_workers.pop_back();
+		workers.back().work_for(as_work_source(task_queue, queue_index), as_idle_strategy(task_queue));
+	}
+}
+
+auto ElasticWorkerPool::shrink() -> void
+{
+	samples_wanting_to_shrink = 0;
+	if (static_cast<int>(workers.size()) <= settings.min_workers)
+		return;
+	// Its pinned tasks would be stuck until the pool grows back.
+	if (task_queue.number_of_pinned_tasks(static_cast<int>(workers.size()) - 1) > 0)
+		return;
+
+	workers.back().work_for(retired_work_source(), retired_idle_strategy());
+	retired_workers.push_back(RetiredWorker{std::move(workers.back()), std::chrono::steady_clock::now()});
+	workers.pop_back();
+	--worker_count;
+}
+
+auto ElasticWorkerPool::has_unowned_pinned_tasks() const noexcept -> bool
+{
+	for (int i = static_cast<int>(workers.size()); i < settings.max_workers; ++i)
+		if (task_queue.number_of_pinned_tasks(i) > 0)
+			return true;
+	return false;
+}
+
+auto ElasticWorkerPool::join_old_retired_workers() -> void
+{
+	auto const now = std::chrono::steady_clock::now();
+	// Retired in order, so the oldest ones are at the front.
+	auto const first_to_keep = std::find_if(retired_workers.begin(), retired_workers.end(), [&](RetiredWorker const & retired)
+	{
+		return now - retired.retired_at < settings.retire_after;
+	});
+	for (auto it = retired_workers.begin(); it != first_to_keep; ++it)
+	{
+		it->worker.join();
+		--thread_count;
+	}
+	retired_workers.erase(retired_workers.begin(), first_to_keep);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "thread_pool.hh"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+
+struct ElasticWorkerPoolSettings
+{
+	// Both are capped at the number of queues of the task queue, so that every worker owns a queue
+	// index, and the tasks pinned to it, on its own. Tasks pinned to an index of max_workers or more
+	// never run.
+	int min_workers = 1;
+	int max_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	// How often the queue is looked at.
+	std::chrono::milliseconds sample_period = std::chrono::milliseconds(10);
+	// How many samples in a row have to agree before a worker is added or retired. Growing should
+	// react fast to a backlog, shrinking should wait until the pool has been idle for a while.
+	int samples_to_grow = 3;
+	int samples_to_shrink = 100;
+	// How long a retired thread is kept around to be reused before it is joined.
+	std::chrono::milliseconds retire_after = std::chrono::seconds(30);
+};
+
+// Owns a set of workers for a task queue and changes how many there are with the load. A worker is
+// added when there are tasks queued and no worker is idle, and one is retired when the queue is
+// empty and some worker is idle. Retired threads are parked with work_for and are put to work again
+// if the pool grows before retire_after, so that bursts don't keep creating and destroying threads.
+// Worker i always works for queue index i. A worker isn't retired while tasks are pinned to it, and
+// tasks pinned to an index that has no worker make the pool grow until one does.
+struct ElasticWorkerPool
+{
+	explicit ElasticWorkerPool(TaskQueue & task_queue, ElasticWorkerPoolSettings settings = ElasticWorkerPoolSettings());
+	~ElasticWorkerPool();
+
+	ElasticWorkerPool(ElasticWorkerPool const &) = delete;
+	ElasticWorkerPool & operator = (ElasticWorkerPool const &) = delete;
+
+	// Workers currently working for the queue.
+	auto number_of_workers() const noexcept -> int { return worker_count; }
+	// Workers plus retired threads that have not been joined yet.
+	auto number_of_threads() const noexcept -> int { return thread_count; }
+
+private:
+	struct RetiredWorker
+	{
+		WorkerThread worker;
+		std::chrono::steady_clock::time_point retired_at;
+	};
+
+	auto monitor() -> void;
+	auto sample() -> void;
+	auto grow() -> void;
+	auto shrink() -> void;
+	auto has_unowned_pinned_tasks() const noexcept -> bool;
+	auto join_old_retired_workers() -> void;
+
+	TaskQueue & task_queue;
+	ElasticWorkerPoolSettings settings;
+
+	// Only touched by the monitor thread, except by the destructor once it has stopped.
+	std::vector<WorkerThread> workers;
+	std::vector<RetiredWorker> retired_workers;
+	int samples_wanting_to_grow = 0;
+	int samples_wanting_to_shrink = 0;
+
+	std::atomic<int> worker_count = 0;
+	std::atomic<int> thread_count = 0;
+
+	std::mutex stop_mutex;
+	std::condition_variable stop_condition;
+	bool stop_requested = false;
+	std::thread monitor_thread;
+};
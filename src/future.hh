@@ -0,0 +1,122 @@
+#pragma once
+
+#include "parker.hh"
+#include "polymorphic_task.hh"
+#include <atomic>
+#include <exception>
+#include <future>
+#include <type_traits>
+#include <utility>
+
+// Single producer, single consumer channel for the result of a task. Unlike std::future, the state
+// shared by a promise and its future is one allocation with no mutex or condition variable. Whether
+// the result is there is an atomic load, and waiting for it parks the thread on an atomic.
+template <typename T>
+struct Future;
+
+template <typename T>
+struct Promise;
+
+namespace detail
+{
+	enum class FutureStatus { empty, value, exception };
+
+	template <typename T>
+	struct FutureState
+	{
+		// void results still need something to construct.
+		using stored_type = std::conditional_t<std::is_void_v<T>, bool, T>;
+
+		FutureState() noexcept {}
+		~FutureState();
+
+		FutureState(FutureState const &) = delete;
+		FutureState & operator = (FutureState const &) = delete;
+
+		auto release() noexcept -> void;
+		auto publish(FutureStatus new_status) -> void;
+		auto set_callback(PolymorphicTask task) -> void;
+
+		std::atomic<FutureStatus> status = FutureStatus::empty;
+		std::atomic<int> references = 1;
+		// Only the thread that waits on the future parks on it.
+		Parker parker;
+		// Whoever sets the second of the two flags runs the callback.
+		static constexpr unsigned result_flag = 1;
+		static constexpr unsigned callback_flag = 2;
+		std::atomic<unsigned> callback_flags = 0;
+		PolymorphicTask callback;
+		union
+		{
+			stored_type value;
+			std::exception_ptr exception;
+		};
+	};
+} // namespace detail
+
+template <typename T>
+struct Future
+{
+	Future() noexcept = default;
+
+	Future(Future const &) = delete;
+	Future & operator = (Future const &) = delete;
+
+	Future(Future && other) noexcept : state(std::exchange(other.state, nullptr)) {}
+	Future & operator = (Future && other) noexcept;
+
+	~Future();
+
+	auto valid() const noexcept -> bool { return state != nullptr; }
+	// Never blocks.
+	auto is_ready() const noexcept -> bool;
+	// Parks the calling thread until there is a result.
+	auto wait() const -> void;
+	// Waits for the result and moves it out of the future, which leaves it invalid. Rethrows the
+	// exception if the promise was given one.
+	auto get() -> T;
+
+	// Unparked when the result is set. Lets a thread park until either the result is ready or something
+	// else happens, like with TaskQueue::wait_for_work.
+	auto parker() const noexcept -> Parker & { return state->parker; }
+
+	// Runs the task once the result is set, on the thread that sets it, or right away on this thread if
+	// it is already set. Keep it short, like pushing a task to an executor. At most one per future.
+	auto on_ready(PolymorphicTask task) -> void;
+
+private:
+	friend struct Promise<T>;
+	explicit Future(detail::FutureState<T> * state_) noexcept : state(state_) {}
+
+	detail::FutureState<T> * state = nullptr;
+};
+
+template <typename T>
+struct Promise
+{
+	Promise() : state(new detail::FutureState<T>()) {}
+
+	Promise(Promise const &) = delete;
+	Promise & operator = (Promise const &) = delete;
+
+	Promise(Promise && other) noexcept : state(std::exchange(other.state, nullptr)) {}
+	Promise & operator = (Promise && other) noexcept;
+
+	// A promise destroyed without a result gives its future a broken_promise std::future_error.
+	~Promise();
+
+	// Can only be called once.
+	auto get_future() -> Future<T>;
+
+	template <typename ... Args> requires(std::is_void_v<T> ? sizeof...(Args) == 0 : std::constructible_from<T, Args...>)
+	auto set_value(Args && ... args) -> void;
+	auto set_exception(std::exception_ptr exception) -> void;
+
+private:
+	auto reset() noexcept -> void;
+
+	detail::FutureState<T> * state;
+	bool satisfied = false;
+};
+
+#include "future.inl"
@@ -0,0 +1,153 @@
+#include <cassert>
+
+namespace detail
+{
+	template <typename T>
+	FutureState<T>::~FutureState()
+	{
+		FutureStatus const s = status.load(std::memory_order_relaxed);
+		if (s == FutureStatus::value)
+			value.~stored_type();
+		else if (s == FutureStatus::exception)
+			exception.~exception_ptr();
+	}
+
+	template <typename T>
+	auto FutureState<T>::release() noexcept -> void
+	{
+		if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete this;
+	}
+
+	template <typename T>
+	auto FutureState<T>::publish(FutureStatus new_status) -> void
+	{
+		status.store(new_status, std::memory_order_release);
+		parker.unpark();
+		if (callback_flags.fetch_or(result_flag, std::memory_order_acq_rel) & callback_flag)
+			callback.consume();
+	}
+
+	template <typename T>
+	auto FutureState<T>::set_callback(PolymorphicTask task) -> void
+	{
+		callback = std::move(task);
+		if (callback_flags.fetch_or(callback_flag, std::memory_order_acq_rel) & result_flag)
+			callback.consume();
+	}
+} // namespace detail
+
+template <typename T>
+Future<T> & Future<T>::operator = (Future && other) noexcept
+{
+	if (this != &other)
+	{
+		if (state)
+			state->release();
+		state = std::exchange(other.state, nullptr);
+	}
+	return *this;
+}
+
+template <typename T>
+Future<T>::~Future()
+{
+	if (state)
+		state->release();
+}
+
+template <typename T>
+auto Future<T>::is_ready() const noexcept -> bool
+{
+	return state && state->status.load(std::memory_order_acquire) != detail::FutureStatus::empty;
+}
+
+template <typename T>
+auto Future<T>::wait() const -> void
+{
+	assert(valid());
+	while (!is_ready())
+		state->parker.park();
+}
+
+template <typename T>
+auto Future<T>::on_ready(PolymorphicTask task) -> void
+{
+	assert(valid() && !(state->callback_flags.load(std::memory_order_relaxed) & detail::FutureState<T>::callback_flag));
+	state->set_callback(std::move(task));
+}
+
+template <typename T>
+auto Future<T>::get() -> T
+{
+	wait();
+	auto * const s = std::exchange(state, nullptr);
+	struct release_on_exit
+	{
+		~release_on_exit() { s->release(); }
+		detail::FutureState<T> * s;
+	} const guard{s};
+
+	if (s->status.load(std::memory_order_relaxed) == detail::FutureStatus::exception)
+		std::rethrow_exception(s->exception);
+	if constexpr (!std::is_void_v<T>)
+		return std::move(s->value);
+}
+
+template <typename T>
+Promise<T> & Promise<T>::operator = (Promise && other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		state = std::exchange(other.state, nullptr);
+		satisfied = other.satisfied;
+	}
+	return *this;
+}
+
+template <typename T>
+Promise<T>::~Promise()
+{
+	reset();
+}
+
+template <typename T>
+auto Promise<T>::reset() noexcept -> void
+{
+	if (!state)
+		return;
+	if (!satisfied)
+		set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+	std::exchange(state, nullptr)->release();
+}
+
+template <typename T>
+auto Promise<T>::get_future() -> Future<T>
+{
+	assert(state && state->references.load(std::memory_order_relaxed) == 1);
+	state->references.fetch_add(1, std::memory_order_relaxed);
+	return Future<T>(state);
+}
+
+template <typename T>
+template <typename ... Args> requires(std::is_void_v<T> ? sizeof...(Args) == 0 : std::constructible_from<T, Args...>)
+auto Promise<T>::set_value(Args && ... args) -> void
+{
+	assert(state && !satisfied);
+	if constexpr (std::is_void_v<T>)
+		::new(&state->value) bool(true);
+	else
+		::new(&state->value) T(std::forward<Args>(args)...);
+	satisfied = true;
+	state->publish(detail::FutureStatus::value);
+}
+
+template <typename T>
+auto Promise<T>::set_exception(std::exception_ptr exception) -> void
+{
+	assert(state && !satisfied);
+	::new(&state->exception) std::exception_ptr(std::move(exception));
+	satisfied = true;
+	state->publish(detail::FutureStatus::exception);
+}
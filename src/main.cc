@@ -1,9 +1,9 @@
 #define CATCH_CONFIG_RUNNER
 #include "catch/catch.hpp"
 
-int main()
+int main(int argc, char * argv[])
 {
-	int const tests_result = Catch::Session().run();
+	int const tests_result = Catch::Session().run(argc, argv);
 	if (tests_result != 0)
 		system("pause");
 }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "wait.hh"
+#include <concepts>
+#include <algorithm>
+
+template <typename E>
+concept is_parallel_loop_executor = is_helpable_task_executor<E> && requires(E & executor) { executor.has_work_queued(); };
+
+// Splits the range in chunk_count chunks of the same size up front. Cheapest when every index costs
+// the same. With a chunk count of 0 there is one chunk per queue of the executor.
+struct StaticPartitioner
+{
+	int chunk_count = 0;
+};
+
+// task_count tasks grab chunks of grain_size indices from a shared counter until there are none
+// left. Balances uneven work at the cost of a contended atomic per chunk. With a task count of 0
+// there is one task per queue of the executor.
+struct DynamicPartitioner
+{
+	size_t grain_size = 1;
+	int task_count = 0;
+};
+
+// Runs the range in grain_size pieces and splits off half of what is left into a new task only if
+// the deque of the calling worker is empty, that is, when the tasks it split off before were stolen
+// and some thread is likely to be idle. Adapts to both uneven work and a busy machine without having
+// to tune a chunk count. The check is a few loads per piece, so pieces of a single cheap index may
+// still be worth making larger. Threads that aren't workers of the executor check every queue.
+struct LazySplittingPartitioner
+{
+	size_t grain_size = 1;
+};
+
+// Calls body for every index in [begin, end) on the threads of the executor, and returns once all of
+// them have finished. The calling thread runs part of the range and runs tasks of the executor while
+// it waits. The bookkeeping lives on the caller's stack, so no chunk allocates anything. If the body
+// throws, the chunks that haven't started yet are skipped and the first exception is rethrown once
+// every running chunk has returned.
+template <is_parallel_loop_executor Executor, std::integral Index, std::invocable<Index> F, typename Partitioner = LazySplittingPartitioner>
+auto parallel_for(Executor & executor, Index begin, Index end, F body, Partitioner partitioner = Partitioner()) -> void;
+
+// Reduces map(i) for every index in [begin, end) with reduce, starting from identity. Each chunk
+// reduces its indices on its own and then combines its partial result into the total under a lock,
+// in no particular order, so reduce has to be associative and commutative.
+template <is_parallel_loop_executor Executor, std::integral Index, typename T, std::invocable<Index> Map, typename Reduce, typename Partitioner = LazySplittingPartitioner>
+	requires std::is_invocable_r_v<T, Reduce, T, std::invoke_result_t<Map, Index>> && std::is_invocable_r_v<T, Reduce, T, T>
+auto parallel_reduce(Executor & executor, Index begin, Index end, T identity, Map map, Reduce reduce, Partitioner partitioner = Partitioner()) -> T;
+
+#include "parallel.inl"
@@ -0,0 +1,266 @@
+#include <mutex>
+#include <exception>
+
+namespace detail
+{
+	template <typename Executor>
+	auto default_parallelism(Executor & executor) -> int
+	{
+		if constexpr (requires { executor.number_of_queues(); })
+			return std::max(executor.number_of_queues(), 1);
+		else
+			return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+
+	// Shared by every task of a loop. Lives on the stack of the thread that started the loop, which
+	// doesn't return until every task has finished with it, even when the body throws.
+	template <typename Executor, typename Index, typename RunChunk>
+	struct ParallelLoop
+	{
+		Executor * executor;
+		RunChunk * run_chunk;
+		Index end;
+		Index grain_size;
+		std::atomic<Index> next;
+		// Starts at one for the calling thread, which finishes its share in wait(). That way the count
+		// can't drop to zero and back while the caller is still spawning tasks.
+		std::atomic<int> pending_tasks = 1;
+		std::atomic<bool> finished = false;
+		Parker parker = {};
+		// The first exception thrown by the body, rethrown by the caller once every task is done.
+		std::atomic<bool> failed = false;
+		std::exception_ptr failure = nullptr;
+
+		// Finishes a spawned task however it exits.
+		struct FinishTaskOnExit
+		{
+			ParallelLoop * loop;
+			~FinishTaskOnExit() { loop->finish_task(); }
+		};
+
+		template <is_task F>
+		auto spawn(F f) -> void
+		{
+			pending_tasks.fetch_add(1, std::memory_order_relaxed);
+			try
+			{
+				executor->run_task(std::move(f));
+			}
+			catch (...)
+			{
+				pending_tasks.fetch_sub(1, std::memory_order_relaxed);
+				throw;
+			}
+		}
+
+		// Must be called from a catch block. Only the first exception is kept.
+		auto fail() noexcept -> void
+		{
+			if (!failed.exchange(true, std::memory_order_relaxed))
+				failure = std::current_exception();
+		}
+
+		// Skips the chunk once something has thrown, the loop is going to be abandoned anyway.
+		auto run(Index b, Index e) noexcept -> void
+		{
+			if (failed.load(std::memory_order_relaxed))
+				return;
+			try
+			{
+				(*run_chunk)(b, e);
+			}
+			catch (...)
+			{
+				fail();
+			}
+		}
+
+		// Must be the last thing a task does with the loop. The last task wakes the caller before it sets
+		// finished, since the loop may be gone as soon as the caller sees it.
+		auto finish_task() noexcept -> void
+		{
+			if (pending_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				parker.unpark();
+				finished.store(true, std::memory_order_release);
+			}
+		}
+
+		// Runs tasks of the executor until every task of the loop has finished, and parks when there are
+		// none to run. Executors that can't park a thread get a yield instead.
+		auto wait() -> void
+		{
+			finish_task();
+			while (!finished.load(std::memory_order_acquire))
+			{
+				if (this_thread::perform_task_for(*executor))
+					continue;
+				if constexpr (requires { executor->wait_for_work(parker); })
+				{
+					if (pending_tasks.load(std::memory_order_acquire) > 0)
+					{
+						executor->wait_for_work(parker);
+						continue;
+					}
+				}
+				std::this_thread::yield();
+			}
+		}
+	};
+
+	template <typename Loop>
+	auto run_static(Loop & loop, int chunk_count, auto begin) -> void
+	{
+		using Index = decltype(begin);
+		Index const size = loop.end - begin;
+		Index const chunk_size = size / chunk_count;
+		Index const remainder = size % chunk_count;
+		auto const chunk_begin = [&](int chunk) { return begin + chunk * chunk_size + std::min(static_cast<Index>(chunk), remainder); };
+
+		for (int chunk = 1; chunk < chunk_count; ++chunk)
+		{
+			loop.spawn([loop_ = &loop, b = chunk_begin(chunk), e = chunk_begin(chunk + 1)]()
+			{
+				auto const finish = typename Loop::FinishTaskOnExit{loop_};
+				loop_->run(b, e);
+			});
+		}
+		loop.run(begin, chunk_begin(1));
+	}
+
+	template <typename Loop>
+	auto run_dynamic(Loop & loop) -> void
+	{
+		while (!loop.failed.load(std::memory_order_relaxed))
+		{
+			auto const b = loop.next.fetch_add(loop.grain_size, std::memory_order_relaxed);
+			if (b >= loop.end)
+				return;
+			loop.run(b, loop.end - b > loop.grain_size ? b + loop.grain_size : loop.end);
+		}
+	}
+
+	// Whether the tasks this thread split off are still sitting in its own deque. If they are gone,
+	// someone stole them and is likely to come back for more.
+	template <typename Executor>
+	auto has_local_work_queued(Executor & executor) -> bool
+	{
+		if constexpr (requires { executor.has_local_work_queued(); })
+			return executor.has_local_work_queued();
+		else
+			return executor.has_work_queued();
+	}
+
+	template <typename Loop, typename Index>
+	auto run_lazy_splitting(Loop & loop, Index begin, Index end) -> void
+	{
+		while (end - begin > loop.grain_size && !loop.failed.load(std::memory_order_relaxed))
+		{
+			if (!has_local_work_queued(*loop.executor))
+			{
+				Index const middle = begin + (end - begin) / 2;
+				loop.spawn([loop_ = &loop, middle, end]()
+				{
+					auto const finish = typename Loop::FinishTaskOnExit{loop_};
+					try
+					{
+						run_lazy_splitting(*loop_, middle, end);
+					}
+					catch (...)
+					{
+						loop_->fail();
+					}
+				});
+				end = middle;
+			}
+			else
+			{
+				loop.run(begin, begin + loop.grain_size);
+				begin += loop.grain_size;
+			}
+		}
+		loop.run(begin, end);
+	}
+
+	template <typename Loop, typename Index>
+	auto run_partitioned(Loop & loop, Index begin, StaticPartitioner partitioner) -> void
+	{
+		int const requested = partitioner.chunk_count > 0 ? partitioner.chunk_count : default_parallelism(*loop.executor);
+		int const chunk_count = static_cast<int>(std::min<Index>(static_cast<Index>(requested), loop.end - begin));
+		run_static(loop, chunk_count, begin);
+	}
+
+	template <typename Loop, typename Index>
+	auto run_partitioned(Loop & loop, Index begin, DynamicPartitioner partitioner) -> void
+	{
+		int const task_count = partitioner.task_count > 0 ? partitioner.task_count : default_parallelism(*loop.executor);
+		loop.grain_size = static_cast<Index>(std::max<size_t>(partitioner.grain_size, 1));
+		loop.next = begin;
+		for (int i = 1; i < task_count; ++i)
+		{
+			loop.spawn([loop_ = &loop]()
+			{
+				auto const finish = typename Loop::FinishTaskOnExit{loop_};
+				run_dynamic(*loop_);
+			});
+		}
+		run_dynamic(loop);
+	}
+
+	template <typename Loop, typename Index>
+	auto run_partitioned(Loop & loop, Index begin, LazySplittingPartitioner partitioner) -> void
+	{
+		loop.grain_size = static_cast<Index>(std::max<size_t>(partitioner.grain_size, 1));
+		run_lazy_splitting(loop, begin, loop.end);
+	}
+
+	// Calls run_chunk(b, e) for disjoint subranges that cover [begin, end).
+	template <typename Executor, typename Index, typename RunChunk, typename Partitioner>
+	auto run_in_chunks(Executor & executor, Index begin, Index end, RunChunk run_chunk, Partitioner partitioner) -> void
+	{
+		if (begin >= end)
+			return;
+
+		ParallelLoop<Executor, Index, RunChunk> loop{std::addressof(executor), std::addressof(run_chunk), end, Index(1), begin};
+		// Spawned tasks point into the loop, so it has to wait for them before anything can leave.
+		try
+		{
+			run_partitioned(loop, begin, partitioner);
+		}
+		catch (...)
+		{
+			loop.fail();
+		}
+		loop.wait();
+		if (loop.failure)
+			std::rethrow_exception(loop.failure);
+	}
+} // namespace detail
+
+template <is_parallel_loop_executor Executor, std::integral Index, std::invocable<Index> F, typename Partitioner>
+auto parallel_for(Executor & executor, Index begin, Index end, F body, Partitioner partitioner) -> void
+{
+	detail::run_in_chunks(executor, begin, end, [&body](Index b, Index e)
+	{
+		for (Index i = b; i < e; ++i)
+			body(i);
+	}, partitioner);
+}
+
+template <is_parallel_loop_executor Executor, std::integral Index, typename T, std::invocable<Index> Map, typename Reduce, typename Partitioner>
+	requires std::is_invocable_r_v<T, Reduce, T, std::invoke_result_t<Map, Index>> && std::is_invocable_r_v<T, Reduce, T, T>
+auto parallel_reduce(Executor & executor, Index begin, Index end, T identity, Map map, Reduce reduce, Partitioner partitioner) -> T
+{
+	T total = identity;
+	std::mutex total_mutex;
+	detail::run_in_chunks(executor, begin, end, [&](Index b, Index e)
+	{
+		T partial = identity;
+		for (Index i = b; i < e; ++i)
+			partial = reduce(std::move(partial), map(i));
+
+		auto const g = std::lock_guard(total_mutex);
+		total = reduce(std::move(total), std::move(partial));
+	}, partitioner);
+	return total;
+}
@@ -0,0 +1,13 @@
+#include "parker.hh"
+
+auto Parker::park() -> void
+{
+	while (!permit.exchange(false, std::memory_order_acquire))
+		permit.wait(false, std::memory_order_relaxed);
+}
+
+auto Parker::unpark() -> void
+{
+	permit.store(true, std::memory_order_release);
+	permit.notify_one();
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <atomic>
+
+// Lets a thread sleep until another thread wakes it up. Unparking a thread that is not parked yet
+// makes its next call to park return immediately, so wake ups can't get lost.
+struct Parker
+{
+	auto park() -> void;
+	auto unpark() -> void;
+
+private:
+	std::atomic<bool> permit = false;
+};
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "task_allocator.hh"
 #include <type_traits>
 #include <concepts>
+#include <cstddef>
 
 template <typename T>
 using function_ptr = T *;
@@ -9,42 +11,66 @@ using function_ptr = T *;
 template <typename F>
 concept is_task = std::move_constructible<F> && std::invocable<F>;
 
-struct PolymorphicTask
+// Tasks of types for which this is true are moved between small buffers by copying their bytes,
+// without calls through the virtual table. Specialize it for types that stay valid when their bytes
+// are moved somewhere else and the original is forgotten.
+template <typename T>
+constexpr bool is_trivially_relocatable = std::is_trivially_copyable_v<T>;
+
+// Doesn't depend on the buffer size so that tasks of every size share the same tables.
+struct PolymorphicTaskVirtualTable
 {
-	struct VirtualTable
-	{
-		function_ptr<void(void *) noexcept> destructor;
-		function_ptr<void(void *, void *) noexcept> move_constructor;
-		function_ptr<void(void *)> operator_function_call;
-	};
+	function_ptr<void(void *) noexcept> destructor;
+	function_ptr<void(void *, void *) noexcept> move_constructor;
+	function_ptr<void(void *)> operator_function_call;
+	// Calls and then destroys, even if the call throws.
+	function_ptr<void(void *)> consume;
+};
+
+// Type erased move only task. Tasks of up to SmallBufferSize bytes and SmallBufferAlignment alignment
+// are stored inline, bigger ones get their memory from Allocator. Pick a size that fits the tasks
+// that are pushed the most, as every slot of a task queue is this big.
+template <size_t SmallBufferSize, size_t SmallBufferAlignment = alignof(std::max_align_t), is_task_allocator Allocator = PooledTaskAllocator>
+struct BasicPolymorphicTask
+{
+	using VirtualTable = PolymorphicTaskVirtualTable;
 	template <typename T>
 	static constexpr auto virtual_table_for() noexcept -> VirtualTable;
 
-	constexpr PolymorphicTask() noexcept = default;
+	static constexpr size_t small_buffer_size = SmallBufferSize;
+	static constexpr size_t small_buffer_alignment = SmallBufferAlignment;
+
+	// Whether a task of type F would be stored without allocating.
+	template <typename F>
+	static constexpr bool fits_small_buffer = sizeof(F) <= small_buffer_size && alignof(F) <= small_buffer_alignment;
+
+	constexpr BasicPolymorphicTask() noexcept = default;
 
 	template <is_task F>
-	PolymorphicTask(F f);
+	BasicPolymorphicTask(F f);
 
-	PolymorphicTask(PolymorphicTask const &) = delete;
-	PolymorphicTask & operator = (PolymorphicTask const &) = delete;
+	BasicPolymorphicTask(BasicPolymorphicTask const &) = delete;
+	BasicPolymorphicTask & operator = (BasicPolymorphicTask const &) = delete;
 
-	PolymorphicTask(PolymorphicTask && other) noexcept;
-	PolymorphicTask & operator = (PolymorphicTask && other) noexcept;
+	BasicPolymorphicTask(BasicPolymorphicTask && other) noexcept;
+	BasicPolymorphicTask & operator = (BasicPolymorphicTask && other) noexcept;
 
-	~PolymorphicTask();
+	~BasicPolymorphicTask();
 
 	constexpr explicit operator bool() const noexcept { return virtual_table != nullptr; }
 
 	void operator () ();
 
+	// Runs the task and destroys it in one go, leaving this empty. Cheaper than calling it and letting
+	// the destructor run later, for tasks that are run exactly once, which is all of them in practice.
+	auto consume() -> void;
+
 private:
 	auto buffer() noexcept -> void *;
 	auto destroy() noexcept -> void;
-	auto move_from_other(PolymorphicTask & other) noexcept -> void;
+	auto move_from_other(BasicPolymorphicTask & other) noexcept -> void;
 
-	static constexpr size_t small_buffer_size = 32;
 	static_assert(small_buffer_size >= 4 * sizeof(void *));
-	static constexpr size_t small_buffer_alignment = 8;
 	static_assert(small_buffer_alignment >= alignof(void *));
 
 	union
@@ -60,37 +86,9 @@ private:
 	};
 	VirtualTable const * virtual_table = nullptr;
 	bool is_small = true;
+	bool is_small_and_trivially_relocatable = false;
 };
 
-template <typename T>
-constexpr auto PolymorphicTask::virtual_table_for() noexcept -> VirtualTable
-{
-	return PolymorphicTask::VirtualTable{
-		[](void * obj) noexcept { static_cast<T *>(obj)->~T(); },
-		[](void * to, void * from) noexcept { ::new(to) T(std::move(*static_cast<T *>(from))); },
-		[](void * obj) noexcept { std::invoke(std::move(*static_cast<T *>(obj))); },
-	};
-}
+using PolymorphicTask = BasicPolymorphicTask<32, 8>;
 
-template <typename T>
-constexpr PolymorphicTask::VirtualTable polymorphic_task_virtual_table_for = PolymorphicTask::virtual_table_for<T>();
-
-template <is_task F>
-PolymorphicTask::PolymorphicTask(F f)
-	: virtual_table(&polymorphic_task_virtual_table_for<F>)
-{
-	if constexpr (sizeof(F) <= small_buffer_size && alignof(F) <= small_buffer_alignment)
-	{
-		is_small = true;
-		::new(buffer()) F(std::move(f));
-	}
-	else
-	{
-		is_small = false;
-		big_buffer.memory = ::operator new(sizeof(F), std::align_val_t(alignof(F)));
-		big_buffer.used_size = sizeof(F);
-		big_buffer.capacity = sizeof(F);
-		big_buffer.object_alignment = alignof(F);
-		::new(big_buffer.memory) F(std::move(f));
-	}
-}
+#include "polymorphic_task.inl"
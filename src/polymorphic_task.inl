@@ -0,0 +1,161 @@
+#include <utility>
+#include <functional>
+#include <new>
+#include <cassert>
+#include <cstring>
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+template <typename T>
+constexpr auto BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::virtual_table_for() noexcept -> VirtualTable
+{
+	return VirtualTable{
+		[](void * obj) noexcept { static_cast<T *>(obj)->~T(); },
+		[](void * to, void * from) noexcept { ::new(to) T(std::move(*static_cast<T *>(from))); },
+		[](void * obj) noexcept { std::invoke(std::move(*static_cast<T *>(obj))); },
+		[](void * obj)
+		{
+			struct DestroyOnExit
+			{
+				T * object;
+				~DestroyOnExit() { object->~T(); }
+			};
+			auto const guard = DestroyOnExit{static_cast<T *>(obj)};
+			std::invoke(std::move(*guard.object));
+		},
+	};
+}
+
+template <typename T>
+constexpr PolymorphicTaskVirtualTable polymorphic_task_virtual_table_for = PolymorphicTask::virtual_table_for<T>();
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+template <is_task F>
+BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::BasicPolymorphicTask(F f)
+	: virtual_table(&polymorphic_task_virtual_table_for<F>)
+{
+	if constexpr (fits_small_buffer<F>)
+	{
+		is_small = true;
+		is_small_and_trivially_relocatable = is_trivially_relocatable<F>;
+		::new(buffer()) F(std::move(f));
+	}
+	else
+	{
+		is_small = false;
+		big_buffer.memory = Allocator::allocate(sizeof(F), alignof(F));
+		big_buffer.used_size = sizeof(F);
+		big_buffer.capacity = sizeof(F);
+		big_buffer.object_alignment = alignof(F);
+		::new(big_buffer.memory) F(std::move(f));
+	}
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::BasicPolymorphicTask(BasicPolymorphicTask && other) noexcept
+{
+	move_from_other(other);
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+auto BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::operator = (BasicPolymorphicTask && other) noexcept -> BasicPolymorphicTask &
+{
+	// If this was to be called more in practical situations I would bother to write a version that
+	// tries to reuse the buffer when possible but I don't really care. Move assignment is a pretty
+	// infrequent operation on tasks in real scenarios.
+	destroy();
+	virtual_table = nullptr;
+	is_small = true;
+	is_small_and_trivially_relocatable = false;
+	move_from_other(other);
+	return *this;
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::~BasicPolymorphicTask()
+{
+	destroy();
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+void BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::operator () ()
+{
+	assert(virtual_table);
+	virtual_table->operator_function_call(buffer());
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+auto BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::consume() -> void
+{
+	assert(virtual_table);
+
+	// Frees a big buffer once the task is gone, also if it throws.
+	struct ReleaseBuffer
+	{
+		BasicPolymorphicTask * task;
+		~ReleaseBuffer()
+		{
+			task->destroy();
+			task->is_small = true;
+		}
+	};
+
+	// Empty before the call, so that destroy doesn't destroy the object again.
+	VirtualTable const * const table = std::exchange(virtual_table, nullptr);
+	is_small_and_trivially_relocatable = false;
+	auto const release = ReleaseBuffer{this};
+	table->consume(buffer());
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+auto BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::buffer() noexcept -> void *
+{
+	if (is_small)
+		return &small_buffer;
+	else
+		return big_buffer.memory;
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+auto BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::destroy() noexcept -> void
+{
+	if (virtual_table)
+		virtual_table->destructor(buffer());
+
+	if (!is_small)
+		Allocator::deallocate(big_buffer.memory, big_buffer.used_size, big_buffer.object_alignment);
+}
+
+template <size_t SmallBufferSize, size_t SmallBufferAlignment, is_task_allocator Allocator>
+auto BasicPolymorphicTask<SmallBufferSize, SmallBufferAlignment, Allocator>::move_from_other(BasicPolymorphicTask & other) noexcept -> void
+{
+	if (other.virtual_table)
+	{
+		if (other.is_small_and_trivially_relocatable)
+		{
+			// Copying the whole buffer is a handful of moves, and cheaper than finding out how big the
+			// task actually is.
+			is_small = true;
+			is_small_and_trivially_relocatable = true;
+			virtual_table = other.virtual_table;
+			std::memcpy(&small_buffer, &other.small_buffer, small_buffer_size);
+			other.virtual_table = nullptr;
+			other.is_small_and_trivially_relocatable = false;
+		}
+		else if (other.is_small)
+		{
+			is_small = true;
+			virtual_table = other.virtual_table;
+			virtual_table->move_constructor(buffer(), other.buffer());
+			virtual_table->destructor(other.buffer());
+			other.virtual_table = nullptr;
+		}
+		else // other is big. Steal the memory
+		{
+			is_small = false;
+			virtual_table = other.virtual_table;
+			big_buffer = other.big_buffer;
+			other.virtual_table = nullptr;
+			other.is_small = true;
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "task.hh"
+#include "cache_line.hh"
+#include <atomic>
+#include <optional>
+#include <utility>
+
+// Executor that runs the tasks given to it one at a time and in the order they were given, on top of
+// another executor. Instead of each task taking a lock on whatever state the strand protects, tasks
+// wait their turn in the strand without blocking any worker. Tasks go to a lock free multi producer
+// single consumer inbox (Dmitry Vyukov's intrusive queue), and a single task that drains it is pushed
+// to the underlying executor whenever the inbox goes from empty to non empty. Drained nodes are kept
+// and reused, so once the strand has warmed up pushing doesn't allocate.
+// The strand must outlive every task given to it.
+template <is_task_executor Executor>
+struct Strand
+{
+	explicit Strand(Executor & executor);
+	~Strand();
+
+	Strand(Strand const &) = delete;
+	Strand & operator = (Strand const &) = delete;
+
+	auto run_task(PolymorphicTask task) -> void;
+
+	// How many tasks a drain runs before it gives the underlying executor's other tasks a turn.
+	static constexpr int drain_batch_size = 32;
+
+private:
+	struct Node
+	{
+		std::atomic<Node *> next = nullptr;
+		PolymorphicTask task;
+	};
+
+	auto drain() -> void;
+	auto try_pop() -> std::optional<PolymorphicTask>;
+	auto schedule_drain() -> void;
+	auto unschedule() -> void;
+	auto allocate_node() -> Node *;
+	auto recycle_node(Node * node) noexcept -> void;
+
+	Executor * executor;
+
+	// Producers swap themselves in at head. The consumer pops from tail, which is always a node whose
+	// task has already been taken.
+	alignas(cache_line_size) std::atomic<Node *> head;
+	alignas(cache_line_size) Node * tail;
+	std::atomic<bool> scheduled = false;
+
+	// Linked through next. Only the drain pushes, and producers only pop while holding the flag, so
+	// a node can't be popped and pushed back while another producer is looking at it.
+	alignas(cache_line_size) std::atomic<Node *> free_nodes = nullptr;
+	std::atomic_flag free_nodes_flag;
+};
+
+#include "strand.inl"
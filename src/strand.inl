@@ -0,0 +1,117 @@
+template <is_task_executor Executor>
+Strand<Executor>::Strand(Executor & executor_)
+	: executor(std::addressof(executor_))
+	, head(new Node())
+	, tail(head.load())
+{}
+
+template <is_task_executor Executor>
+Strand<Executor>::~Strand()
+{
+	while (tail)
+		delete std::exchange(tail, tail->next.load());
+	for (Node * node = free_nodes.load(); node;)
+		delete std::exchange(node, node->next.load());
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::run_task(PolymorphicTask task) -> void
+{
+	Node * const node = allocate_node();
+	node->task = std::move(task);
+	Node * const previous = head.exchange(node);
+	previous->next.store(node, std::memory_order_release);
+
+	// Only the push that finds the strand idle schedules a drain.
+	if (!scheduled.exchange(true))
+		schedule_drain();
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::schedule_drain() -> void
+{
+	executor->run_task([this]() { drain(); });
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::try_pop() -> std::optional<PolymorphicTask>
+{
+	// Also empty while a producer has swapped in its node but not linked it yet.
+	Node * const next = tail->next.load(std::memory_order_acquire);
+	if (!next)
+		return std::nullopt;
+
+	auto task = std::move(next->task);
+	recycle_node(std::exchange(tail, next));
+	return task;
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::allocate_node() -> Node *
+{
+	// Producers that find another one popping just allocate, it's rare and cheaper than waiting.
+	if (!free_nodes_flag.test_and_set(std::memory_order_acquire))
+	{
+		Node * node = free_nodes.load(std::memory_order_acquire);
+		while (node && !free_nodes.compare_exchange_weak(node, node->next.load(std::memory_order_relaxed), std::memory_order_acquire)) {}
+		free_nodes_flag.clear(std::memory_order_release);
+		if (node)
+		{
+			node->next.store(nullptr, std::memory_order_relaxed);
+			return node;
+		}
+	}
+	return new Node();
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::recycle_node(Node * node) noexcept -> void
+{
+	// Its task has already been moved out.
+	Node * top = free_nodes.load(std::memory_order_relaxed);
+	do node->next.store(top, std::memory_order_relaxed);
+	while (!free_nodes.compare_exchange_weak(top, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::drain() -> void
+{
+	// On every way out but a full batch, including a task that throws. Otherwise the strand would stay
+	// scheduled with nobody left to drain it.
+	struct UnscheduleOnExit
+	{
+		Strand * strand;
+		~UnscheduleOnExit()
+		{
+			if (strand)
+				strand->unschedule();
+		}
+	};
+	auto guard = UnscheduleOnExit{this};
+
+	for (int i = 0; i < drain_batch_size; ++i)
+	{
+		auto task = try_pop();
+		if (!task)
+			return;
+		task->consume();
+	}
+
+	// Still scheduled, let the rest of the executor run before continuing.
+	guard.strand = nullptr;
+	schedule_drain();
+}
+
+template <is_task_executor Executor>
+auto Strand<Executor>::unschedule() -> void
+{
+	// Read tail while this is still the only drain. As soon as scheduled is cleared, a producer may
+	// schedule another one that moves it.
+	Node * const last = tail;
+
+	// Pairs with the exchange in run_task. Either the producer sees that we are done and schedules
+	// a new drain, or we see its node here and schedule it ourselves.
+	scheduled.store(false);
+	if (head.load() != last && !scheduled.exchange(true))
+		schedule_drain();
+}
@@ -2,6 +2,8 @@
 
 #include "polymorphic_task.hh"
 #include "function_traits.hh"
+#include "cancellation.hh"
+#include <optional>
 #include <utility>
 
 template <typename T>
@@ -15,6 +17,97 @@ auto task(F && f, Args && ... args);
 template <typename E>
 concept is_task_executor = requires(E & executor, PolymorphicTask f) { executor.run_task(std::move(f)); };
 
+enum class TaskPriority { high, normal, low };
+constexpr int number_of_task_priorities = 3;
+
+// Executor that runs tasks of higher priority before tasks of lower priority.
+template <typename E>
+concept is_prioritized_task_executor = is_task_executor<E> && requires(E & executor, PolymorphicTask f, TaskPriority p) { executor.run_task(std::move(f), p); };
+
+// Executor that can run a task on one specific worker.
+template <typename E>
+concept is_pinnable_task_executor = is_task_executor<E> && requires(E & executor, PolymorphicTask f, int worker_index) { executor.push_task_pinned(std::move(f), worker_index); };
+
+struct PinnedWorker
+{
+	int index;
+};
+
+namespace detail
+{
+	// The priority of the continuation task running on this thread, if it was given one. Continuations
+	// it schedules without a priority of their own get the same one, so a whole chain keeps the
+	// priority of its first hop.
+	inline thread_local std::optional<TaskPriority> chain_priority;
+
+	struct ChainPriorityScope
+	{
+		explicit ChainPriorityScope(std::optional<TaskPriority> priority) noexcept : previous(std::exchange(chain_priority, priority)) {}
+		~ChainPriorityScope() { chain_priority = previous; }
+
+		ChainPriorityScope(ChainPriorityScope const &) = delete;
+		ChainPriorityScope & operator = (ChainPriorityScope const &) = delete;
+
+	private:
+		std::optional<TaskPriority> previous;
+	};
+
+	// How a ScheduledContinuation hands its task over to the executor, and whether it should at all.
+	// Tasks are passed as they are so that they are type erased straight into the task type of the
+	// executor.
+	struct run_task_with_priority
+	{
+		template <is_prioritized_task_executor TaskExecutor, is_task F>
+		auto operator () (TaskExecutor & executor, F t) const -> void
+		{
+			executor.run_task([priority_ = priority, t_ = std::move(t)]() mutable
+			{
+				auto const scope = ChainPriorityScope(priority_);
+				std::invoke(std::move(t_));
+			}, priority);
+		}
+		constexpr auto is_cancelled() const noexcept -> bool { return false; }
+
+		TaskPriority priority;
+	};
+
+	// Inherits the priority of the chain it is scheduled from, if any.
+	struct run_task_normally
+	{
+		template <is_task_executor TaskExecutor, is_task F>
+		auto operator () (TaskExecutor & executor, F t) const -> void
+		{
+			if constexpr (is_prioritized_task_executor<TaskExecutor>)
+			{
+				if (chain_priority)
+					return run_task_with_priority{*chain_priority}(executor, std::move(t));
+			}
+			executor.run_task(std::move(t));
+		}
+		constexpr auto is_cancelled() const noexcept -> bool { return false; }
+	};
+
+	struct run_task_pinned
+	{
+		template <is_pinnable_task_executor TaskExecutor, is_task F>
+		auto operator () (TaskExecutor & executor, F t) const -> void { executor.push_task_pinned(std::move(t), worker.index); }
+		constexpr auto is_cancelled() const noexcept -> bool { return false; }
+
+		PinnedWorker worker;
+	};
+
+	template <typename RunTask>
+	struct run_task_unless_cancelled
+	{
+		template <is_task_executor TaskExecutor, is_task F>
+		auto operator () (TaskExecutor & executor, F t) const -> void { run_task(executor, std::move(t)); }
+		auto is_cancelled() const noexcept -> bool { return token.is_cancelled(); }
+
+		[[no_unique_address]] RunTask run_task;
+		CancellationToken token;
+	};
+} // namespace detail
+
 template <typename T>
 using result_type = typename T::result_type;
 
@@ -98,27 +191,72 @@ private:
 	F function;
 };
 
-template <is_task_executor TaskExecutor, typename Arg, typename Result, typename F> 
+// A task that, if its token has been cancelled by the time it is run, doesn't run and neither do
+// any of its continuations. Can only be run as a task, its result is only seen by continuations.
+template <typename T>
+struct Cancellable
+{
+	explicit Cancellable(CancellationToken token_, T t) noexcept : token(std::move(token_)), function(std::move(t)) {}
+
+	using result_type = typename T::result_type;
+
+	auto operator () () -> void
+	{
+		if (!token.is_cancelled())
+			std::invoke(std::move(function));
+	}
+
+	template <is_continuation<result_type> C>
+	[[nodiscard]] auto then(C c) const &
+	{
+		auto with_continuation = function.then(std::move(c));
+		return Cancellable<decltype(with_continuation)>(token, std::move(with_continuation));
+	}
+
+	template <is_continuation<result_type> C>
+	[[nodiscard]] auto then(C c) && noexcept
+	{
+		auto with_continuation = std::move(function).then(std::move(c));
+		return Cancellable<decltype(with_continuation)>(std::move(token), std::move(with_continuation));
+	}
+
+private:
+	CancellationToken token;
+	T function;
+};
+
+// Bind arguments in a callable in order to make it a task that is dropped if the token is cancelled.
+template <typename F, typename ... Args> requires std::invocable<F, Args...>
+auto task(CancellationToken token, F && f, Args && ... args);
+
+template <is_task_executor TaskExecutor, typename Arg, typename Result, typename F, typename RunTask = detail::run_task_normally>
 struct ScheduledContinuation
 {
-	explicit ScheduledContinuation(TaskExecutor * exec, F f) noexcept
+	explicit ScheduledContinuation(TaskExecutor * exec, F f, RunTask run_task_ = RunTask()) noexcept
 		: executor(exec)
 		, function(std::move(f))
+		, run_task(std::move(run_task_))
 	{}
 
 	using argument_type = Arg;
 	using result_type = Result;
 
-	auto operator () (Arg arg) -> void { executor->run_task(task(std::move(function), std::move(arg))); }
+	// A cancelled chain is dropped here, before its next task is even created.
+	auto operator () (Arg arg) -> void
+	{
+		if (!run_task.is_cancelled())
+			run_task(*executor, task(std::move(function), std::move(arg)));
+	}
 
 	template <is_continuation<result_type> C>
 	[[nodiscard]] auto then(C c) const &
 	{
 		auto with_continuation = function.then(std::move(c));
 		using continuation_t = decltype(with_continuation);
-		return ScheduledContinuation<TaskExecutor, argument_type, result_type, continuation_t>(
+		return ScheduledContinuation<TaskExecutor, argument_type, result_type, continuation_t, RunTask>(
 			executor,
-			std::move(with_continuation)
+			std::move(with_continuation),
+			run_task
 		);
 	}
 
@@ -127,20 +265,39 @@ struct ScheduledContinuation
 	{
 		auto with_continuation = std::move(function).then(std::move(c));
 		using continuation_t = decltype(with_continuation);
-		return ScheduledContinuation<TaskExecutor, argument_type, result_type, continuation_t>(
+		return ScheduledContinuation<TaskExecutor, argument_type, result_type, continuation_t, RunTask>(
 			executor,
-			std::move(with_continuation)
+			std::move(with_continuation),
+			run_task
 		);
 	}
 
 private:
 	TaskExecutor * executor;
 	F function;
+	[[no_unique_address]] RunTask run_task;
 };
 
+// Without a priority, the task of the continuation gets the one of the continuation it was chained
+// from, or the default one if there is none.
 template <typename F, is_task_executor TaskExecutor, typename ... Args>
 auto continuation(F f, TaskExecutor & executor, Args && ... args);
 
+// The task of the continuation is run with the given priority, and so are the continuations chained
+// after it that don't have a priority of their own.
+template <typename F, is_prioritized_task_executor TaskExecutor, typename ... Args>
+auto continuation(F f, TaskExecutor & executor, TaskPriority priority, Args && ... args);
+
+// The task of the continuation only runs on the given worker.
+template <typename F, is_pinnable_task_executor TaskExecutor, typename ... Args>
+auto continuation(F f, TaskExecutor & executor, PinnedWorker worker, Args && ... args);
+
+// The continuation is dropped if the token has been cancelled by the time its task would be scheduled.
+template <typename F, is_task_executor TaskExecutor, typename ... Args>
+auto continuation(CancellationToken token, F f, TaskExecutor & executor, Args && ... args);
+template <typename F, is_prioritized_task_executor TaskExecutor, typename ... Args>
+auto continuation(CancellationToken token, F f, TaskExecutor & executor, TaskPriority priority, Args && ... args);
+
 template <typename A, typename B>
 auto operator >> (A && a, B && b) noexcept(noexcept(std::forward<A>(a).then(std::forward<B>(b))))
 	-> decltype(std::forward<A>(a).then(std::forward<B>(b)));
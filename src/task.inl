@@ -7,20 +7,66 @@ auto task(F && f, Args && ... args)
 	});
 }
 
+template <typename F, typename ... Args> requires std::invocable<F, Args...>
+auto task(CancellationToken token, F && f, Args && ... args)
+{
+	auto t = task(std::forward<F>(f), std::forward<Args>(args)...);
+	return Cancellable<decltype(t)>(std::move(token), std::move(t));
+}
+
+namespace detail
+{
+	template <is_task_executor TaskExecutor, typename RunTask, typename F, typename ... Args>
+	auto make_scheduled_continuation(TaskExecutor & executor, RunTask run_task, F f, Args && ... args)
+	{
+		using first_param = first_parameter_type_t<F>;
+		using result = std::invoke_result_t<F, first_param, Args...>;
+
+		auto bound = [f_ = std::move(f), ...args_ = std::forward<Args>(args)](first_param x) mutable
+		{
+			return std::invoke(std::move(f_), std::move(x), std::move(args_)...);
+		};
+		using bound_t = decltype(bound);
+		using packaged_task_t = Continuable<bound_t, first_param>;
+
+		return ScheduledContinuation<TaskExecutor, first_param, result, packaged_task_t, RunTask>(
+			std::addressof(executor),
+			packaged_task_t(std::move(bound)),
+			std::move(run_task)
+		);
+	}
+} // namespace detail
+
 template <typename F, is_task_executor TaskExecutor, typename ... Args>
 auto continuation(F f, TaskExecutor & executor, Args && ... args)
 {
-	using first_param = first_parameter_type_t<F>;
-	using result = std::invoke_result_t<F, first_param, Args...>;
+	return detail::make_scheduled_continuation(executor, detail::run_task_normally(), std::move(f), std::forward<Args>(args)...);
+}
 
-	auto bound = [f_ = std::move(f), ...args_ = std::forward<Args>(args)](first_param x) mutable
-	{
-		return std::invoke(std::move(f_), std::move(x), std::move(args_)...);
-	};
-	using bound_t = decltype(bound);
-	using packaged_task_t = Continuable<bound_t, first_param>;
-	
-	return ScheduledContinuation<TaskExecutor, first_param, result, packaged_task_t>(std::addressof(executor), packaged_task_t(std::move(bound)));
+template <typename F, is_prioritized_task_executor TaskExecutor, typename ... Args>
+auto continuation(F f, TaskExecutor & executor, TaskPriority priority, Args && ... args)
+{
+	return detail::make_scheduled_continuation(executor, detail::run_task_with_priority{priority}, std::move(f), std::forward<Args>(args)...);
+}
+
+template <typename F, is_pinnable_task_executor TaskExecutor, typename ... Args>
+auto continuation(F f, TaskExecutor & executor, PinnedWorker worker, Args && ... args)
+{
+	return detail::make_scheduled_continuation(executor, detail::run_task_pinned{worker}, std::move(f), std::forward<Args>(args)...);
+}
+
+template <typename F, is_task_executor TaskExecutor, typename ... Args>
+auto continuation(CancellationToken token, F f, TaskExecutor & executor, Args && ... args)
+{
+	auto run_task = detail::run_task_unless_cancelled<detail::run_task_normally>{detail::run_task_normally(), std::move(token)};
+	return detail::make_scheduled_continuation(executor, std::move(run_task), std::move(f), std::forward<Args>(args)...);
+}
+
+template <typename F, is_prioritized_task_executor TaskExecutor, typename ... Args>
+auto continuation(CancellationToken token, F f, TaskExecutor & executor, TaskPriority priority, Args && ... args)
+{
+	auto run_task = detail::run_task_unless_cancelled<detail::run_task_with_priority>{detail::run_task_with_priority{priority}, std::move(token)};
+	return detail::make_scheduled_continuation(executor, std::move(run_task), std::move(f), std::forward<Args>(args)...);
 }
 
 template <typename A, typename B>
@@ -0,0 +1,256 @@
+#include "task_allocator.hh"
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+auto NewDeleteTaskAllocator::allocate(size_t size, size_t alignment) -> void *
+{
+	return ::operator new(size, std::align_val_t(alignment));
+}
+
+auto NewDeleteTaskAllocator::deallocate(void * memory, size_t size, size_t alignment) noexcept -> void
+{
+	::operator delete(memory, size, std::align_val_t(alignment));
+}
+
+namespace
+{
+	// Blocks of 64, 128, 256, 512 and 1024 bytes, header included.
+	constexpr int size_class_count = 5;
+	constexpr size_t smallest_block_size = 64;
+	constexpr size_t max_pooled_alignment = alignof(std::max_align_t);
+	// Past this many free blocks of a class, a thread gives blocks freed locally back to the system.
+	constexpr int max_free_blocks_per_class = 256;
+
+	struct ThreadCache;
+
+	// In front of every block, so that whoever frees it knows where it goes back to. Null owner
+	// means the block didn't come from a pool.
+	struct alignas(max_pooled_alignment) BlockHeader
+	{
+		ThreadCache * owner;
+		int size_class;
+	};
+	static_assert(sizeof(BlockHeader) == max_pooled_alignment);
+
+	// Overlaps the memory of a free block after its header.
+	struct FreeBlock
+	{
+		FreeBlock * next;
+	};
+
+	constexpr auto block_size(int size_class) noexcept -> size_t
+	{
+		return smallest_block_size << size_class;
+	}
+
+	auto size_class_for(size_t size) noexcept -> int
+	{
+		size_t const needed = size + sizeof(BlockHeader);
+		if (needed <= smallest_block_size)
+			return 0;
+		return static_cast<int>(std::bit_width((needed - 1) / smallest_block_size));
+	}
+
+	auto header_of(void * memory) noexcept -> BlockHeader *
+	{
+		return static_cast<BlockHeader *>(memory) - 1;
+	}
+
+	auto memory_of(BlockHeader * header) noexcept -> void *
+	{
+		return header + 1;
+	}
+
+	// Unpooled memory starts this far into its allocation, which is aligned to the same amount, so
+	// that it keeps the alignment that was asked for and the header still fits right before it.
+	// Alignments are powers of two, so this is a multiple of both.
+	auto unpooled_offset(size_t alignment) noexcept -> size_t
+	{
+		return std::max(alignment, sizeof(BlockHeader));
+	}
+
+	// Incremented only by the thread that owns the cache, so there is no need for read-modify-write.
+	auto increment(std::atomic<uint64_t> & counter) noexcept -> void
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	struct ThreadCache
+	{
+		std::array<FreeBlock *, size_class_count> local_free = {};
+		std::array<int, size_class_count> local_free_count = {};
+		// Pushed to by other threads. The owner takes the whole list at once, so there is no ABA.
+		std::array<std::atomic<FreeBlock *>, size_class_count> remote_free = {};
+
+		std::atomic<uint64_t> allocations = 0;
+		std::atomic<uint64_t> pool_misses = 0;
+		std::atomic<uint64_t> remote_frees = 0;
+	};
+
+	// Caches are never destroyed, as there may be blocks of them anywhere. There are as many as
+	// threads have ever been allocating at the same time.
+	struct CacheRegistry
+	{
+		std::mutex mutex;
+		std::vector<ThreadCache *> all;
+		std::vector<ThreadCache *> idle;
+		std::atomic<uint64_t> unpooled_allocations = 0;
+	};
+
+	auto registry() -> CacheRegistry &
+	{
+		// Leaked on purpose, threads may still free tasks after static destructors start running.
+		static CacheRegistry * const instance = new CacheRegistry;
+		return *instance;
+	}
+
+	struct ThreadCacheLease
+	{
+		ThreadCacheLease()
+		{
+			CacheRegistry & r = registry();
+			auto const g = std::lock_guard(r.mutex);
+			if (r.idle.empty())
+			{
+				cache = new ThreadCache;
+				r.all.push_back(cache);
+			}
+			else
+			{
+				cache = r.idle.back();
+				r.idle.pop_back();
+			}
+		}
+
+		~ThreadCacheLease();
+
+		ThreadCache * cache;
+	};
+
+	// Trivially destructible, so that it can still be read after the lease is gone.
+	thread_local bool thread_cache_released = false;
+
+	ThreadCacheLease::~ThreadCacheLease()
+	{
+		thread_cache_released = true;
+		CacheRegistry & r = registry();
+		auto const g = std::lock_guard(r.mutex);
+		r.idle.push_back(cache);
+	}
+
+	// Null while the thread is exiting.
+	auto this_thread_cache() -> ThreadCache *
+	{
+		if (thread_cache_released)
+			return nullptr;
+		thread_local ThreadCacheLease lease;
+		return lease.cache;
+	}
+
+	auto allocate_block(ThreadCache * owner, int size_class) -> BlockHeader *
+	{
+		auto * const header = static_cast<BlockHeader *>(::operator new(block_size(size_class)));
+		header->owner = owner;
+		header->size_class = size_class;
+		return header;
+	}
+
+	auto pop_free_block(ThreadCache & cache, int size_class) noexcept -> BlockHeader *
+	{
+		if (!cache.local_free[size_class])
+		{
+			FreeBlock * returned = cache.remote_free[size_class].exchange(nullptr, std::memory_order_acquire);
+			int count = 0;
+			for (FreeBlock * b = returned; b; b = b->next)
+				count++;
+			cache.local_free[size_class] = returned;
+			cache.local_free_count[size_class] = count;
+		}
+
+		FreeBlock * const block = cache.local_free[size_class];
+		if (!block)
+			return nullptr;
+		cache.local_free[size_class] = block->next;
+		cache.local_free_count[size_class]--;
+		return header_of(block);
+	}
+}
+
+auto PooledTaskAllocator::allocate(size_t size, size_t alignment) -> void *
+{
+	ThreadCache * const cache = this_thread_cache();
+	if (!cache || alignment > max_pooled_alignment || size_class_for(size) >= size_class_count)
+	{
+		registry().unpooled_allocations.fetch_add(1, std::memory_order_relaxed);
+		size_t const offset = unpooled_offset(alignment);
+		auto * const base = static_cast<std::byte *>(::operator new(size + offset, std::align_val_t(offset)));
+		void * const memory = base + offset;
+		header_of(memory)->owner = nullptr;
+		return memory;
+	}
+
+	int const size_class = size_class_for(size);
+	increment(cache->allocations);
+	if (BlockHeader * const header = pop_free_block(*cache, size_class))
+		return memory_of(header);
+
+	increment(cache->pool_misses);
+	return memory_of(allocate_block(cache, size_class));
+}
+
+auto PooledTaskAllocator::deallocate(void * memory, size_t size, size_t alignment) noexcept -> void
+{
+	BlockHeader * const header = header_of(memory);
+	ThreadCache * const owner = header->owner;
+	if (!owner)
+	{
+		size_t const offset = unpooled_offset(alignment);
+		::operator delete(static_cast<std::byte *>(memory) - offset, size + offset, std::align_val_t(offset));
+		return;
+	}
+
+	int const size_class = header->size_class;
+	FreeBlock * const block = static_cast<FreeBlock *>(memory);
+	ThreadCache * const cache = this_thread_cache();
+	if (cache == owner)
+	{
+		if (cache->local_free_count[size_class] >= max_free_blocks_per_class)
+		{
+			::operator delete(header, block_size(size_class));
+			return;
+		}
+		block->next = cache->local_free[size_class];
+		cache->local_free[size_class] = block;
+		cache->local_free_count[size_class]++;
+	}
+	else
+	{
+		if (cache)
+			increment(cache->remote_frees);
+		FreeBlock * head = owner->remote_free[size_class].load(std::memory_order_relaxed);
+		do block->next = head;
+		while (!owner->remote_free[size_class].compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+	}
+}
+
+auto PooledTaskAllocator::stats() noexcept -> TaskAllocatorStats
+{
+	CacheRegistry & r = registry();
+	TaskAllocatorStats result;
+	result.unpooled_allocations = r.unpooled_allocations.load(std::memory_order_relaxed);
+	auto const g = std::lock_guard(r.mutex);
+	for (ThreadCache const * cache : r.all)
+	{
+		result.allocations += cache->allocations.load(std::memory_order_relaxed);
+		result.pool_misses += cache->pool_misses.load(std::memory_order_relaxed);
+		result.remote_frees += cache->remote_frees.load(std::memory_order_relaxed);
+	}
+	result.allocations += result.unpooled_allocations;
+	return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+// Where tasks that don't fit in the small buffer of a BasicPolymorphicTask get their memory from.
+// Stateless, so that a task doesn't have to carry an allocator around. Memory may be freed on a
+// different thread than the one that allocated it.
+template <typename A>
+concept is_task_allocator = requires(size_t size, size_t alignment, void * memory)
+{
+	{ A::allocate(size, alignment) } -> std::same_as<void *>;
+	A::deallocate(memory, size, alignment);
+};
+
+// Aligned ::operator new and ::operator delete.
+struct NewDeleteTaskAllocator
+{
+	static auto allocate(size_t size, size_t alignment) -> void *;
+	static auto deallocate(void * memory, size_t size, size_t alignment) noexcept -> void;
+};
+
+// Counters of PooledTaskAllocator, added up over every thread. Approximate while other threads are
+// allocating.
+struct TaskAllocatorStats
+{
+	// Every allocation, which is every task that didn't fit in its small buffer.
+	uint64_t allocations = 0;
+	// Allocations that found no free block of their size class and had to call ::operator new.
+	uint64_t pool_misses = 0;
+	// Allocations too big or too aligned for any size class, or made while the thread was exiting.
+	// They go straight to ::operator new.
+	uint64_t unpooled_allocations = 0;
+	// Blocks freed by a thread other than the one that allocated them.
+	uint64_t remote_frees = 0;
+};
+
+// Keeps freed blocks in per thread free lists of a few size classes, so that the usual case of
+// allocating a task is popping a list. A block freed on another thread is pushed to a lock free list
+// of the thread that allocated it, which takes them all back at once when its own list runs dry.
+// The lists of a thread that exits are kept and handed to the next thread that starts allocating.
+struct PooledTaskAllocator
+{
+	static auto allocate(size_t size, size_t alignment) -> void *;
+	static auto deallocate(void * memory, size_t size, size_t alignment) noexcept -> void;
+
+	static auto stats() noexcept -> TaskAllocatorStats;
+};
@@ -0,0 +1,64 @@
+#include "task_graph.hh"
+#include <cassert>
+
+auto TaskGraph::add_node(std::function<void()> node_work) -> NodeId
+{
+	work.push_back(std::move(node_work));
+	compiled = false;
+	return number_of_nodes() - 1;
+}
+
+auto TaskGraph::add_edge(NodeId before, NodeId after) -> void
+{
+	assert(before >= 0 && before < number_of_nodes());
+	assert(after >= 0 && after < number_of_nodes());
+	assert(before != after);
+	edges.emplace_back(before, after);
+	compiled = false;
+}
+
+auto TaskGraph::compile() -> void
+{
+	int const node_count = number_of_nodes();
+
+	// Counting sort of the edges by their first node.
+	successor_offsets.assign(node_count + 1, 0);
+	dependency_counts.assign(node_count, 0);
+	for (auto const & [before, after] : edges)
+	{
+		successor_offsets[before + 1]++;
+		dependency_counts[after]++;
+	}
+	for (int i = 0; i < node_count; ++i)
+		successor_offsets[i + 1] += successor_offsets[i];
+
+	successors.resize(edges.size());
+	std::vector<int> next_slot(successor_offsets.begin(), successor_offsets.end() - 1);
+	for (auto const & [before, after] : edges)
+		successors[next_slot[before]++] = after;
+
+	roots.clear();
+	for (int i = 0; i < node_count; ++i)
+		if (dependency_counts[i] == 0)
+			roots.push_back(i);
+
+#ifndef NDEBUG
+	// Kahn's algorithm. If it can't reach every node there is a cycle, and run would never finish.
+	std::vector<int> counts = dependency_counts;
+	std::vector<NodeId> ready = roots;
+	int reached = 0;
+	while (!ready.empty())
+	{
+		NodeId const node = ready.back();
+		ready.pop_back();
+		reached++;
+		for (int i = successor_offsets[node]; i < successor_offsets[node + 1]; ++i)
+			if (--counts[successors[i]] == 0)
+				ready.push_back(successors[i]);
+	}
+	assert(reached == node_count);
+#endif
+
+	pending_dependencies = std::make_unique<std::atomic<int>[]>(node_count);
+	compiled = true;
+}
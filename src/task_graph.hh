@@ -0,0 +1,69 @@
+#pragma once
+
+#include "wait.hh"
+#include <functional>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <exception>
+
+// Tasks with dependencies between them, to be run many times. Nodes and edges are declared once and
+// compiled into flat arrays. Running the graph again only resets a counter per node, and doesn't
+// allocate anything.
+struct TaskGraph
+{
+	using NodeId = int;
+
+	TaskGraph() = default;
+	TaskGraph(TaskGraph const &) = delete;
+	TaskGraph & operator = (TaskGraph const &) = delete;
+
+	auto add_node(std::function<void()> work) -> NodeId;
+	// after doesn't start until before has finished.
+	auto add_edge(NodeId before, NodeId after) -> void;
+
+	// run does this if the graph changed since the last time. Call it up front to keep the allocations
+	// out of the first run. The graph must not have cycles.
+	auto compile() -> void;
+
+	// Runs every node once on the executor, each of them after all of its predecessors, and returns
+	// once all of them have finished. The calling thread runs tasks of the executor while it waits, and
+	// parks when there are none. If a node throws, the nodes that haven't started yet are skipped and
+	// run rethrows the first exception once the rest have finished. A graph can't run again until the
+	// previous run returns.
+	template <is_helpable_task_executor Executor>
+	auto run(Executor & executor) -> void;
+
+	auto number_of_nodes() const noexcept -> int { return static_cast<int>(work.size()); }
+
+private:
+	template <typename Executor>
+	auto schedule(Executor & executor, NodeId node) -> void;
+	template <typename Executor>
+	auto run_node(Executor & executor, NodeId node) -> void;
+
+	// As declared.
+	std::vector<std::function<void()>> work;
+	std::vector<std::pair<NodeId, NodeId>> edges;
+
+	// Compiled. Successors of node i are successors[successor_offsets[i]] up to
+	// successors[successor_offsets[i + 1]].
+	bool compiled = false;
+	std::vector<int> successor_offsets;
+	std::vector<NodeId> successors;
+	std::vector<int> dependency_counts;
+	std::vector<NodeId> roots;
+
+	// Per run.
+	std::unique_ptr<std::atomic<int>[]> pending_dependencies;
+	std::atomic<int> nodes_left = 0;
+	// Set after the last node has been counted and the parker unparked, so run doesn't return while
+	// the graph is still being touched.
+	std::atomic<bool> finished = false;
+	std::atomic<bool> failed = false;
+	std::exception_ptr failure;
+	Parker parker;
+};
+
+#include "task_graph.inl"
@@ -0,0 +1,91 @@
+template <is_helpable_task_executor Executor>
+auto TaskGraph::run(Executor & executor) -> void
+{
+	if (!compiled)
+		compile();
+
+	int const node_count = number_of_nodes();
+	if (node_count == 0)
+		return;
+
+	// Relaxed is enough, pushing the roots publishes this to whoever runs them.
+	for (int i = 0; i < node_count; ++i)
+		pending_dependencies[i].store(dependency_counts[i], std::memory_order_relaxed);
+	nodes_left.store(node_count, std::memory_order_relaxed);
+	finished.store(false, std::memory_order_relaxed);
+	failed.store(false, std::memory_order_relaxed);
+
+	for (NodeId const root : roots)
+		schedule(executor, root);
+
+	while (!finished.load(std::memory_order_acquire))
+	{
+		if (this_thread::perform_task_for(executor))
+			continue;
+
+		// The last node has been counted but hasn't set finished yet, which is a matter of instructions.
+		if (nodes_left.load(std::memory_order_acquire) == 0)
+			std::this_thread::yield();
+		// The last node unparks the parker, so this wakes up for either.
+		else if constexpr (requires { executor.wait_for_work(parker); })
+			executor.wait_for_work(parker);
+		else
+			std::this_thread::yield();
+	}
+
+	if (failure)
+		std::rethrow_exception(std::exchange(failure, nullptr));
+}
+
+template <typename Executor>
+auto TaskGraph::schedule(Executor & executor, NodeId node) -> void
+{
+	// Three words, always fits in the small buffer.
+	executor.run_task([this, executor_ = std::addressof(executor), node]() { run_node(*executor_, node); });
+}
+
+template <typename Executor>
+auto TaskGraph::run_node(Executor & executor, NodeId node) -> void
+{
+	while (true)
+	{
+		if (!failed.load(std::memory_order_relaxed))
+		{
+			try
+			{
+				work[node]();
+			}
+			catch (...)
+			{
+				// Successors are still counted down, so that the run gets to the end.
+				if (!failed.exchange(true, std::memory_order_relaxed))
+					failure = std::current_exception();
+			}
+		}
+
+		// Of the successors that this node makes ready, run one right here and push the rest.
+		NodeId next = -1;
+		for (int i = successor_offsets[node]; i < successor_offsets[node + 1]; ++i)
+		{
+			NodeId const successor = successors[i];
+			if (pending_dependencies[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				if (next == -1)
+					next = successor;
+				else
+					schedule(executor, successor);
+			}
+		}
+
+		// Once finished is set, run may return and the graph be destroyed.
+		if (nodes_left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			parker.unpark();
+			finished.store(true, std::memory_order_release);
+			return;
+		}
+		if (next == -1)
+			return;
+		node = next;
+	}
+}
@@ -1,9 +1,24 @@
 #include "thread_pool.hh"
+#include "bounded_task_queue.hh"
+#include "elastic_worker_pool.hh"
 #include "task.hh"
+#include "timer_queue.hh"
+#include "strand.hh"
+#include "parallel.hh"
+#include "wait.hh"
+#include "co_task.hh"
+#include "task_graph.hh"
 #include "async.hh"
 #include "when_all.hh"
+#include "when_any.hh"
 #include "catch/catch.hpp"
 #include <chrono>
+#include <algorithm>
+
+#if defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
 
 using namespace std::literals;
 
@@ -136,7 +151,7 @@ TEST_CASE("async pushes a task to an executor and returns a future that will hol
 {
 	auto task_queue = TaskQueue(1);
 
-	std::future<int> future = async(task_queue, task([]() { return 5; }));
+	Future<int> future = async(task_queue, task([]() { return 5; }));
 
 	REQUIRE(!is_ready(future)); // task hasn't run yet
 
@@ -361,3 +376,1241 @@ TEST_CASE("Can pass a move only type to a continuation of a continuation as long
 
 	REQUIRE(i == 5);
 }
+
+TEST_CASE("A queue pops its own tasks newest first and steals tasks from other queues oldest first")
+{
+	auto task_queue = TaskQueue(2);
+
+	std::vector<int> order;
+	for (int i = 0; i < 3; ++i)
+		task_queue.push_task([&order, i]() { order.push_back(i); }, 0);
+
+	(*task_queue.pop_task(0))();
+	(*task_queue.pop_task(1))();
+	(*task_queue.pop_task(0))();
+
+	REQUIRE(order == std::vector<int>{2, 0, 1});
+	REQUIRE(!task_queue.has_work_queued());
+}
+
+TEST_CASE("Tasks that don't fit in the ring of a queue are still run")
+{
+	auto task_queue = TaskQueue(2);
+
+	int tasks_run = 0;
+	for (int i = 0; i < 1000; ++i)
+		task_queue.push_task([&tasks_run]() { tasks_run++; }, 0);
+
+	// Queue 1 has to take the tasks that overflowed queue 0.
+	REQUIRE(this_thread::work_until_no_tasks_left_for(task_queue, 1) == 1000);
+	REQUIRE(tasks_run == 1000);
+}
+
+TEST_CASE("Worker threads run every task pushed to a queue exactly once")
+{
+	auto task_queue = TaskQueue(4);
+
+	constexpr int task_count = 10'000;
+	std::atomic<int> tasks_run = 0;
+	std::vector<std::atomic<int>> runs_per_task(task_count);
+
+	{
+		auto workers = make_workers_for_queue(task_queue);
+		for (int i = 0; i < task_count; ++i)
+			task_queue.push_task([&tasks_run, &runs_per_task, i]() { runs_per_task[i]++; tasks_run++; });
+
+		while (tasks_run < task_count)
+			std::this_thread::yield();
+	}
+
+	REQUIRE(tasks_run == task_count);
+	REQUIRE(std::all_of(runs_per_task.begin(), runs_per_task.end(), [](std::atomic<int> const & runs) { return runs == 1; }));
+}
+
+TEST_CASE("Idle workers park until a task is pushed to their queue")
+{
+	auto task_queue = TaskQueue(2);
+	auto workers = make_workers_for_queue(task_queue, 2, 0);
+
+	while (task_queue.number_of_parked_threads() < 2)
+		std::this_thread::yield();
+
+	std::atomic<int> i = 0;
+	task_queue.push_task([&i]() { i = 5; });
+
+	while (i != 5)
+		std::this_thread::yield();
+
+	REQUIRE(i == 5);
+	// Workers that are parked must still be able to join.
+	for (WorkerThread & worker : workers)
+		worker.join();
+	REQUIRE(task_queue.number_of_parked_threads() == 0);
+}
+
+TEST_CASE("Tasks pushed by a worker go to the queue of that worker")
+{
+	auto task_queue = TaskQueue(3);
+
+	// Calling a work source registers this thread as the worker of queue 1.
+	auto const work_source = as_work_source(task_queue, 1);
+	std::array<PolymorphicTask, 1> batch;
+	REQUIRE(work_source(batch) == 0);
+	REQUIRE(this_thread::worker_queue_index(task_queue) == 1);
+
+	int i = 0;
+	for (int n = 1; n <= 3; ++n)
+		task_queue.push_task([&i, n]() { i = n; });
+
+	// All of them are in queue 1, so it pops the newest one first. In round robin it would have been the second one.
+	(*task_queue.pop_task(1))();
+	REQUIRE(i == 3);
+
+	this_thread::unregister_as_worker();
+	REQUIRE(this_thread::worker_queue_index(task_queue) == std::nullopt);
+	this_thread::work_until_no_tasks_left_for(task_queue);
+}
+
+TEST_CASE("try_push on a bounded task queue fails once the queue is full")
+{
+	auto task_queue = BoundedTaskQueue(4);
+	REQUIRE(task_queue.capacity() == 4);
+
+	int i = 0;
+	for (int n = 0; n < 4; ++n)
+		REQUIRE(task_queue.try_push([&i]() { i++; }));
+
+	PolymorphicTask rejected = [&i]() { i += 10; };
+	REQUIRE(!task_queue.try_push(std::move(rejected)));
+	REQUIRE(rejected); // The task wasn't moved from.
+	REQUIRE(task_queue.number_of_queued_tasks() == 4);
+
+	// Popping makes room again.
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(task_queue.try_push(std::move(rejected)));
+
+	REQUIRE(this_thread::work_until_no_tasks_left_for(task_queue) == 4);
+	REQUIRE(i == 4 + 10);
+}
+
+TEST_CASE("A bounded task queue is an executor for continuations and async")
+{
+	auto task_queue = BoundedTaskQueue(8);
+
+	int i = 0;
+	Future<int> future = async(task_queue, task([]() { return 5; }));
+	REQUIRE(task_queue.try_push(task([]() { return 2; }).then(continuation([&i](int x) { i = x; }, task_queue))));
+
+	this_thread::work_until_no_tasks_left_for(task_queue);
+
+	REQUIRE(future.get() == 5);
+	REQUIRE(i == 2);
+}
+
+TEST_CASE("Running a task on a full bounded task queue runs the oldest queued task to make room")
+{
+	auto task_queue = BoundedTaskQueue(2);
+
+	std::vector<int> order;
+	task_queue.run_task([&order]() { order.push_back(1); });
+	task_queue.run_task([&order]() { order.push_back(2); });
+	REQUIRE(order.empty());
+	task_queue.run_task([&order]() { order.push_back(3); });
+	REQUIRE(order == std::vector<int>{1});
+
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(order == std::vector<int>{1, 2, 3});
+}
+
+TEST_CASE("Continuation chains on a full bounded task queue still run in order")
+{
+	auto task_queue = BoundedTaskQueue(2);
+
+	std::vector<std::string> order;
+	auto const chain = [&](std::string name)
+	{
+		return task([&order, name]() { order.push_back(name + "a"); return name + "b"; })
+			.then(continuation([&order](std::string next) { order.push_back(next); }, task_queue));
+	};
+	REQUIRE(task_queue.try_push(chain("0")));
+	REQUIRE(task_queue.try_push(chain("1")));
+	// Makes room by running the first two chains as far as they go, and their continuations queue up
+	// behind them instead of running right away.
+	task_queue.run_task(chain("2"));
+
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(order == std::vector<std::string>{"0a", "1a", "0b", "1b", "2a", "2b"});
+}
+
+TEST_CASE("Tasks of higher priority are popped before tasks of lower priority")
+{
+	auto task_queue = TaskQueue(2);
+
+	std::vector<int> order;
+	task_queue.push_task([&order]() { order.push_back(3); }, TaskPriority::low);
+	task_queue.push_task([&order]() { order.push_back(2); }, TaskPriority::normal);
+	task_queue.push_task([&order]() { order.push_back(1); }, TaskPriority::high);
+	// Even if it is in a different queue.
+	task_queue.push_task([&order]() { order.push_back(0); }, 1, TaskPriority::high);
+
+	REQUIRE(task_queue.number_of_queued_tasks() == 4);
+	REQUIRE(task_queue.number_of_queued_tasks(TaskPriority::high) == 2);
+
+	this_thread::work_until_no_tasks_left_for(task_queue, 0);
+
+	REQUIRE(order == std::vector<int>{1, 0, 2, 3});
+}
+
+TEST_CASE("continuation and async can give a priority to the tasks they push")
+{
+	auto task_queue = TaskQueue(1);
+
+	std::vector<int> order;
+	task_queue.push_task(task([]() { return 1; })
+		.then(continuation([&order](int x) { order.push_back(x); }, task_queue, TaskPriority::high))
+	);
+	Future<int> future = async(task_queue, task([&order]() { order.push_back(3); return 3; }), TaskPriority::low);
+
+	// Runs the first task, which pushes its continuation with high priority.
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	task_queue.push_task([&order]() { order.push_back(2); });
+
+	this_thread::work_until_no_tasks_left_for(task_queue);
+
+	REQUIRE(order == std::vector<int>{1, 2, 3});
+	REQUIRE(future.get() == 3);
+}
+
+TEST_CASE("Continuations without a priority keep the one of the chain they are in")
+{
+	auto task_queue = TaskQueue(1);
+
+	int result = 0;
+	task_queue.push_task(task([]() { return 1; })
+		.then(continuation([](int x) { return x + 1; }, task_queue, TaskPriority::high)
+			.then(continuation([](int x) { return x + 1; }, task_queue)
+				.then(continuation([&result](int x) { result = x + 1; }, task_queue))))
+	);
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(task_queue.number_of_queued_tasks(TaskPriority::high) == 1);
+
+	// Each hop pushes the next one with high priority, ahead of this unrelated task.
+	bool unrelated_ran = false;
+	task_queue.push_task([&unrelated_ran]() { unrelated_ran = true; });
+	for (int hop = 0; hop < 2; ++hop)
+	{
+		REQUIRE(this_thread::perform_task_for(task_queue));
+		REQUIRE(task_queue.number_of_queued_tasks(TaskPriority::high) == 1);
+		REQUIRE(task_queue.number_of_queued_tasks(TaskPriority::normal) == 1);
+	}
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(result == 4);
+	REQUIRE(!unrelated_ran);
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(unrelated_ran);
+
+	// A continuation chained from a task without a priority stays at the default one.
+	task_queue.push_task(task([]() { return 1; }).then(continuation([&result](int x) { result = x; }, task_queue)));
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(task_queue.number_of_queued_tasks(TaskPriority::normal) == 1);
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(result == 1);
+}
+
+TEST_CASE("Tasks can be pushed and popped in batches")
+{
+	auto task_queue = TaskQueue(2);
+
+	int sum = 0;
+	std::vector<PolymorphicTask> tasks;
+	for (int i = 1; i <= 6; ++i)
+		tasks.push_back([&sum, i]() { sum += i; });
+
+	REQUIRE(task_queue.push_tasks(tasks, 0) == 0);
+	REQUIRE(task_queue.number_of_queued_tasks() == 6);
+
+	// Only takes half of the tasks of its own queue, leaving the rest to be stolen.
+	std::array<PolymorphicTask, 8> batch;
+	REQUIRE(task_queue.pop_tasks(0, batch) == 3);
+	REQUIRE(task_queue.number_of_queued_tasks() == 3);
+	for (int i = 0; i < 3; ++i)
+		batch[i]();
+	REQUIRE(sum == 6 + 5 + 4);
+
+	// A queue with nothing of its own steals one task at a time.
+	REQUIRE(task_queue.pop_tasks(1, batch) == 1);
+	batch[0]();
+	REQUIRE(sum == 6 + 5 + 4 + 1);
+
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(sum == 21);
+}
+
+TEST_CASE("Steal orders visit queues of closer CPUs first")
+{
+	// Two nodes, each with one L3 cache and two cores of two hardware threads.
+	auto const topology = CpuTopology({
+		LogicalCpu{0, 0, 0, 0}, LogicalCpu{1, 1, 0, 0}, LogicalCpu{2, 0, 0, 0}, LogicalCpu{3, 1, 0, 0},
+		LogicalCpu{4, 4, 4, 1}, LogicalCpu{5, 5, 4, 1}, LogicalCpu{6, 4, 4, 1}, LogicalCpu{7, 5, 4, 1},
+	});
+	REQUIRE(topology.cpus[0].id == 0);
+	REQUIRE(topology.cpus[1].id == 2);
+	REQUIRE(distance(topology.cpus[0], topology.cpus[1]) == CpuDistance::smt_sibling);
+	REQUIRE(distance(topology.cpus[0], topology.cpus[2]) == CpuDistance::shared_l3_cache);
+	REQUIRE(distance(topology.cpus[0], topology.cpus[4]) == CpuDistance::remote_numa_node);
+
+	auto const orders = make_steal_orders(topology, 8);
+	REQUIRE(orders[0] == std::vector<int>{1, 2, 3, 4, 5, 6, 7});
+	REQUIRE(orders[2] == std::vector<int>{3, 0, 1, 4, 5, 6, 7});
+	REQUIRE(orders[5] == std::vector<int>{4, 6, 7, 0, 1, 2, 3});
+
+	// Queue 0 steals from queue 3, which is on the same node, before queue 4, which isn't.
+	auto task_queue = TaskQueue(8);
+	task_queue.set_steal_orders(orders);
+	std::vector<int> order;
+	task_queue.push_task([&order]() { order.push_back(4); }, 4);
+	task_queue.push_task([&order]() { order.push_back(3); }, 3);
+	while (auto task = task_queue.pop_task(0))
+		(*task)();
+	REQUIRE(order == std::vector<int>{3, 4});
+}
+
+TEST_CASE("Workers can be placed on the CPUs of the machine")
+{
+	auto const topology = CpuTopology::detect();
+	REQUIRE(!topology.cpus.empty());
+
+	int const cpu_count = static_cast<int>(topology.cpus.size());
+	auto task_queue = TaskQueue(cpu_count);
+	std::atomic<int> count = 0;
+	for (int i = 0; i < 100; ++i)
+		task_queue.push_task([&count]() { ++count; });
+
+	auto workers = make_workers_for_queue(task_queue, topology);
+	REQUIRE(static_cast<int>(workers.size()) == cpu_count);
+	while (count < 100)
+		std::this_thread::yield();
+
+#if defined(__linux__)
+	// Each worker reads back which CPUs it may run on, and it has to be exactly the one it was given.
+	std::vector<cpu_set_t> affinities(cpu_count);
+	std::atomic<int> read_count = 0;
+	for (int i = 0; i < cpu_count; ++i)
+	{
+		task_queue.push_task_pinned([&affinities, &read_count, i]()
+		{
+			CPU_ZERO(&affinities[i]);
+			sched_getaffinity(0, sizeof(cpu_set_t), &affinities[i]);
+			++read_count;
+		}, i);
+	}
+	while (read_count < cpu_count)
+		std::this_thread::yield();
+	for (int i = 0; i < cpu_count; ++i)
+	{
+		REQUIRE(CPU_COUNT(&affinities[i]) == 1);
+		REQUIRE(CPU_ISSET(topology.cpus[i].id, &affinities[i]));
+	}
+#endif
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+#if defined(__linux__)
+TEST_CASE("Pinning a thread restricts it to exactly that CPU")
+{
+	auto const topology = CpuTopology::detect();
+	int const cpu_id = topology.cpus.back().id;
+
+	std::atomic<bool> release = false;
+	auto thread = std::thread([&release]() { while (!release) std::this_thread::yield(); });
+	bool const pinned = pin_thread_to_cpu(thread, cpu_id);
+
+	cpu_set_t affinity;
+	CPU_ZERO(&affinity);
+	int const read_result = pthread_getaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &affinity);
+	release = true;
+	thread.join();
+
+	REQUIRE(pinned);
+	REQUIRE(read_result == 0);
+	REQUIRE(CPU_COUNT(&affinity) == 1);
+	REQUIRE(CPU_ISSET(cpu_id, &affinity));
+}
+#endif
+
+TEST_CASE("An elastic worker pool grows while there is a backlog and shrinks when idle")
+{
+	auto task_queue = TaskQueue(3);
+
+	// Each of these keeps its worker busy, so the other tasks stay queued until there are more workers.
+	std::atomic<bool> release = false;
+	std::atomic<int> running = 0;
+	for (int i = 0; i < 3; ++i)
+		task_queue.push_task([&]() { ++running; while (!release) std::this_thread::yield(); });
+
+	ElasticWorkerPoolSettings settings;
+	settings.min_workers = 1;
+	settings.max_workers = 3;
+	settings.sample_period = std::chrono::milliseconds(1);
+	settings.samples_to_grow = 2;
+	settings.samples_to_shrink = 5;
+	settings.retire_after = std::chrono::milliseconds(0);
+	auto pool = ElasticWorkerPool(task_queue, settings);
+
+	while (running < 3)
+		std::this_thread::yield();
+	REQUIRE(pool.number_of_workers() == 3);
+
+	release = true;
+	while (pool.number_of_threads() > 1)
+		std::this_thread::yield();
+	REQUIRE(pool.number_of_workers() == 1);
+
+	// The one left still works for the queue.
+	std::atomic<bool> done = false;
+	task_queue.push_task([&done]() { done = true; });
+	while (!done)
+		std::this_thread::yield();
+}
+
+TEST_CASE("The elastic pool doesn't strand tasks pinned to a worker it retired")
+{
+	auto task_queue = TaskQueue(3);
+
+	std::atomic<bool> release = false;
+	std::atomic<int> running = 0;
+	for (int i = 0; i < 3; ++i)
+		task_queue.push_task([&]() { ++running; while (!release) std::this_thread::yield(); });
+
+	ElasticWorkerPoolSettings settings;
+	settings.min_workers = 1;
+	settings.max_workers = 8;
+	settings.sample_period = std::chrono::milliseconds(1);
+	settings.samples_to_grow = 2;
+	settings.samples_to_shrink = 5;
+	settings.retire_after = std::chrono::milliseconds(0);
+	auto pool = ElasticWorkerPool(task_queue, settings);
+
+	while (running < 3)
+		std::this_thread::yield();
+	// Never more workers than queues, or two of them would share the pinned tasks of one index.
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	REQUIRE(pool.number_of_workers() == 3);
+
+	release = true;
+	while (pool.number_of_threads() > 1)
+		std::this_thread::yield();
+	REQUIRE(pool.number_of_workers() == 1);
+
+	// The last worker is gone, so the pool has to bring it back to run this.
+	std::atomic<bool> done = false;
+	std::optional<int> ran_on;
+	task_queue.push_task_pinned([&]() { ran_on = this_thread::worker_queue_index(task_queue); done = true; }, 2);
+	while (!done)
+		std::this_thread::yield();
+	REQUIRE(ran_on == 2);
+}
+
+TEST_CASE("A timer queue pushes tasks to the target queue once they are due")
+{
+	auto task_queue = TaskQueue(1);
+	auto timers = TimerQueue(task_queue);
+
+	auto const start = TimerQueue::Clock::now();
+	std::atomic<int> run_count = 0;
+	TimerQueue::Clock::time_point ran_at;
+	bool cancelled_ran = false;
+	timers.run_task_after([&]() { ran_at = TimerQueue::Clock::now(); ++run_count; }, std::chrono::milliseconds(20));
+	timers.run_task_at([&]() { ++run_count; }, start);
+	auto const cancelled = timers.run_task_after([&]() { cancelled_ran = true; }, std::chrono::milliseconds(10));
+	REQUIRE(timers.cancel(cancelled));
+	REQUIRE(!timers.cancel(cancelled));
+
+	while (run_count < 2)
+		this_thread::work_until_no_tasks_left_for(task_queue);
+
+	REQUIRE(ran_at - start >= std::chrono::milliseconds(20));
+	REQUIRE(!cancelled_ran);
+	REQUIRE(timers.number_of_pending_timers() == 0);
+}
+
+TEST_CASE("Periodic timers push a task on every tick until they are cancelled")
+{
+	auto task_queue = TaskQueue(1);
+	auto timers = TimerQueue(task_queue);
+
+	int ticks = 0;
+	auto const id = timers.run_periodic([&ticks]() { ++ticks; }, std::chrono::milliseconds(1));
+	while (ticks < 3)
+		this_thread::work_until_no_tasks_left_for(task_queue);
+
+	REQUIRE(timers.cancel(id));
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	int const ticks_when_cancelled = ticks;
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(ticks == ticks_when_cancelled);
+}
+
+TEST_CASE("Cancelling a chain drops it at the next scheduling point")
+{
+	auto task_queue = TaskQueue(1);
+	auto source = CancellationSource();
+
+	std::vector<int> order;
+	task_queue.push_task(task(source.token(), [&order]() { order.push_back(1); return 2; })
+		.then(continuation(source.token(), [&order](int i) { order.push_back(i); return 3; }, task_queue)
+			.then(continuation(source.token(), [&order](int i) { order.push_back(i); }, task_queue))));
+
+	// The first task runs and schedules the second one, which is cancelled before it runs. It still
+	// runs because it was already scheduled, but the third is never scheduled.
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	source.cancel();
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(!this_thread::perform_task_for(task_queue));
+	REQUIRE(order == std::vector<int>{1, 2});
+
+	// A cancelled task doesn't run at all.
+	task_queue.push_task(task(source.token(), [&order]() { order.push_back(4); }));
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(order == std::vector<int>{1, 2});
+}
+
+TEST_CASE("A cancelled when_all doesn't schedule its continuation")
+{
+	auto task_queue = TaskQueue(1);
+	auto source = CancellationSource();
+
+	int i = 0;
+	auto [t1, t2] = when_all(source.token(), [&i](int a, int b) { i = a + b; }, task_queue,
+		task([]() { return 1; }),
+		task([]() { return 2; })
+	);
+	task_queue.push_task(std::move(t1));
+	task_queue.push_task(std::move(t2));
+
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	source.cancel();
+	REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(task_queue.number_of_queued_tasks() == 0);
+	REQUIRE(i == 0);
+}
+
+TEST_CASE("Every steal policy finds tasks in every queue")
+{
+	auto const policy = GENERATE(StealPolicy::linear, StealPolicy::random, StealPolicy::power_of_two_choices);
+	auto task_queue = TaskQueue(4, policy);
+
+	int sum = 0;
+	for (int i = 1; i < 4; ++i)
+		for (int j = 0; j < i; ++j)
+			task_queue.push_task([&sum, i]() { sum += i; }, i);
+
+	REQUIRE(this_thread::work_until_no_tasks_left_for(task_queue, 0) == 6);
+	REQUIRE(sum == 1 + 2 * 2 + 3 * 3);
+	REQUIRE(!task_queue.has_work_queued());
+}
+
+TEST_CASE("Pinned tasks are only run by the worker they are pinned to")
+{
+	auto task_queue = TaskQueue(2);
+
+	std::vector<int> order;
+	task_queue.push_task_pinned([&order]() { order.push_back(1); }, 1);
+	task_queue.push_task_pinned([&order]() { order.push_back(2); }, 1);
+	task_queue.push_task([&order]() { order.push_back(3); }, 1);
+	REQUIRE(task_queue.number_of_queued_tasks() == 3);
+	REQUIRE(task_queue.number_of_queued_tasks(TaskPriority::normal) == 1);
+
+	// Queue 0 may steal the normal task, but not the pinned ones.
+	REQUIRE(this_thread::work_until_no_tasks_left_for(task_queue, 0) == 1);
+	REQUIRE(order == std::vector<int>{3});
+	REQUIRE(task_queue.number_of_queued_tasks() == 2);
+	REQUIRE(task_queue.has_work_queued());
+
+	// The worker they are pinned to runs them first and in order.
+	task_queue.push_task([&order]() { order.push_back(4); }, 1);
+	REQUIRE(this_thread::work_until_no_tasks_left_for(task_queue, 1) == 3);
+	REQUIRE(order == std::vector<int>{3, 1, 2, 4});
+	REQUIRE(!task_queue.has_work_queued());
+}
+
+TEST_CASE("A continuation can be pinned to a worker")
+{
+	auto task_queue = TaskQueue(2);
+	auto workers = make_workers_for_queue(task_queue, 1);
+
+	// The main thread is worker 1 of the queue and only runs what is pinned to it.
+	std::thread::id continuation_thread;
+	std::atomic<bool> done = false;
+	task_queue.push_task(task([]() { return 5; })
+		.then(continuation([&](int i) { continuation_thread = std::this_thread::get_id(); done = i == 5; }, task_queue, PinnedWorker{1})));
+
+	while (!done)
+		this_thread::perform_task_for(task_queue, 1);
+	REQUIRE(continuation_thread == std::this_thread::get_id());
+
+	// A parked worker wakes up for tasks pinned to it.
+	while (task_queue.number_of_parked_threads() == 0)
+		std::this_thread::yield();
+	std::atomic<bool> ran_on_worker = false;
+	task_queue.push_task_pinned([&ran_on_worker]() { ran_on_worker = true; }, 0);
+	while (!ran_on_worker)
+		std::this_thread::yield();
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("A strand runs its tasks one at a time and in order")
+{
+	auto task_queue = TaskQueue(4);
+	auto strand = Strand(task_queue);
+
+	// Not atomic on purpose, the strand has to be enough.
+	std::vector<int> order;
+	std::vector<std::thread> producers;
+	for (int p = 0; p < 2; ++p)
+	{
+		producers.emplace_back([&, p]()
+		{
+			for (int i = 0; i < 500; ++i)
+				strand.run_task([&order, p, i]() { order.push_back(p * 1000 + i); });
+		});
+	}
+	auto workers = make_workers_for_queue(task_queue);
+	for (std::thread & producer : producers)
+		producer.join();
+
+	// Runs one last task on the strand to know when everything before it has run.
+	std::atomic<bool> done = false;
+	strand.run_task([&done]() { done = true; });
+	while (!done)
+		std::this_thread::yield();
+	for (WorkerThread & worker : workers)
+		worker.join();
+
+	REQUIRE(order.size() == 1000);
+	for (int p = 0; p < 2; ++p)
+	{
+		std::vector<int> from_producer;
+		std::copy_if(order.begin(), order.end(), std::back_inserter(from_producer), [p](int x) { return x / 1000 == p; });
+		REQUIRE(std::is_sorted(from_producer.begin(), from_producer.end()));
+		REQUIRE(from_producer.size() == 500);
+	}
+}
+
+TEST_CASE("parallel_for calls the body once for every index with every partitioner")
+{
+	auto task_queue = TaskQueue(4);
+	auto workers = make_workers_for_queue(task_queue, 3);
+
+	std::vector<std::atomic<int>> calls(1000);
+	auto const body = [&calls](int i) { calls[i]++; };
+	parallel_for(task_queue, 0, 1000, body, StaticPartitioner());
+	parallel_for(task_queue, 0, 1000, body, StaticPartitioner{7});
+	parallel_for(task_queue, 0, 1000, body, DynamicPartitioner{16});
+	parallel_for(task_queue, 0, 1000, body, LazySplittingPartitioner{8});
+	parallel_for(task_queue, 0, 1000, body);
+	parallel_for(task_queue, 0, 0, body);
+	parallel_for(task_queue, 3, 1, body);
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+
+	REQUIRE(std::all_of(calls.begin(), calls.end(), [](std::atomic<int> const & c) { return c == 5; }));
+}
+
+TEST_CASE("parallel_for parks the calling thread while the other chunks run")
+{
+	auto task_queue = TaskQueue(1);
+	auto workers = make_workers_for_queue(task_queue, 1);
+
+	// The worker's chunk only returns once the caller has parked, so a caller that spins never ends.
+	std::atomic<bool> worker_started = false;
+	parallel_for(task_queue, 0, 2, [&](int i)
+	{
+		if (i == 0)
+		{
+			while (!worker_started)
+				std::this_thread::yield();
+		}
+		else
+		{
+			worker_started = true;
+			while (task_queue.number_of_parked_threads() == 0)
+				std::this_thread::yield();
+		}
+	}, StaticPartitioner{2});
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("parallel_for waits for every chunk and rethrows when the body throws")
+{
+	auto task_queue = TaskQueue(2);
+	auto workers = make_workers_for_queue(task_queue, 1);
+	auto const caller = std::this_thread::get_id();
+
+	// The caller doesn't get past its first index before the worker has started one, so both of them
+	// are always in the loop when one of them throws.
+	auto const check = [&](auto partitioner, bool throw_on_caller)
+	{
+		std::atomic<bool> worker_started = false;
+		std::atomic<int> running_on_worker = 0;
+		auto const body = [&](int)
+		{
+			if (std::this_thread::get_id() == caller)
+			{
+				while (!worker_started)
+					std::this_thread::yield();
+				if (throw_on_caller)
+					throw std::runtime_error("caller");
+			}
+			else
+			{
+				running_on_worker++;
+				worker_started = true;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				running_on_worker--;
+				if (!throw_on_caller)
+					throw std::runtime_error("worker");
+			}
+		};
+		REQUIRE_THROWS_WITH(parallel_for(task_queue, 0, 100, body, partitioner), throw_on_caller ? "caller" : "worker");
+		REQUIRE(running_on_worker == 0);
+	};
+
+	for (bool const throw_on_caller : {true, false})
+	{
+		check(StaticPartitioner{2}, throw_on_caller);
+		check(DynamicPartitioner{1, 2}, throw_on_caller);
+		check(LazySplittingPartitioner{1}, throw_on_caller);
+	}
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("parallel_reduce combines the results of every index")
+{
+	auto task_queue = TaskQueue(4);
+	auto workers = make_workers_for_queue(task_queue, 3);
+
+	auto const square = [](int64_t i) { return i * i; };
+	auto const sum = [](int64_t a, int64_t b) { return a + b; };
+	int64_t const expected = 9999ll * 10000 * 19999 / 6;
+	REQUIRE(parallel_reduce(task_queue, int64_t(0), int64_t(10000), int64_t(0), square, sum) == expected);
+	REQUIRE(parallel_reduce(task_queue, int64_t(0), int64_t(10000), int64_t(0), square, sum, StaticPartitioner()) == expected);
+	REQUIRE(parallel_reduce(task_queue, int64_t(0), int64_t(10000), int64_t(0), square, sum, DynamicPartitioner{100}) == expected);
+
+	// Works without any workers, the calling thread does everything.
+	auto lonely_queue = TaskQueue(1);
+	REQUIRE(parallel_reduce(lonely_queue, 1, 11, 0, [](int i) { return i; }, sum) == 55);
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("Waiting for a future on a worker runs the tasks that it depends on")
+{
+	// With a single worker, blocking on the inner future would deadlock.
+	auto task_queue = TaskQueue(1);
+	auto workers = make_workers_for_queue(task_queue, 1);
+
+	Future<int> outer = async(task_queue, task([&task_queue]()
+	{
+		Future<int> inner = async(task_queue, task([]() { return 2; }));
+		return this_thread::wait_for(inner, task_queue) * 3;
+	}));
+	auto handle = HelpingFuture(std::move(outer), task_queue);
+	REQUIRE(handle.get() == 6);
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+namespace
+{
+	auto add_on(TaskQueue & task_queue, int a, int b) -> CoTask<int>
+	{
+		co_await schedule_on(task_queue);
+		co_return a + b;
+	}
+
+	auto add_twice_on(TaskQueue & task_queue, std::vector<int> & steps) -> CoTask<int>
+	{
+		int const x = co_await add_on(task_queue, 1, 2);
+		steps.push_back(x);
+		int const y = co_await add_on(task_queue, x, 3);
+		steps.push_back(y);
+		co_return y;
+	}
+
+	auto wait_for_future(TaskQueue & task_queue, std::future<int> & future) -> CoTask<void>
+	{
+		co_await schedule_on(task_queue);
+		int const i = co_await resume_when_ready(future, task_queue);
+		if (i != 4)
+			throw std::runtime_error("Wrong result");
+	}
+}
+
+TEST_CASE("Coroutines can move to a task queue and await each other")
+{
+	auto task_queue = TaskQueue(1);
+
+	std::vector<int> steps;
+	Future<int> result = async(task_queue, add_twice_on(task_queue, steps));
+
+	// Nothing runs until the queue is worked on. Every hop to the queue is a task.
+	REQUIRE(steps.empty());
+	REQUIRE(this_thread::work_until_no_tasks_left_for(task_queue) == 3);
+	REQUIRE(steps == std::vector<int>{3, 6});
+	REQUIRE(result.get() == 6);
+}
+
+TEST_CASE("Coroutines can await futures")
+{
+	auto task_queue = TaskQueue(1);
+
+	std::promise<int> promise;
+	std::future<int> future = promise.get_future();
+	Future<void> done = async(task_queue, wait_for_future(task_queue, future));
+
+	for (int i = 0; i < 5; ++i)
+		REQUIRE(this_thread::perform_task_for(task_queue));
+	REQUIRE(!is_ready(done));
+
+	promise.set_value(4);
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(is_ready(done));
+	done.get();
+}
+
+TEST_CASE("A future gets the value or the exception given to its promise")
+{
+	Promise<std::unique_ptr<int>> promise;
+	Future<std::unique_ptr<int>> future = promise.get_future();
+	REQUIRE(future.valid());
+	REQUIRE(!future.is_ready());
+
+	auto setter = std::thread([&promise]() { promise.set_value(std::make_unique<int>(7)); });
+	REQUIRE(*future.get() == 7);
+	REQUIRE(!future.valid());
+	setter.join();
+
+	Future<void> failed;
+	{
+		Promise<void> broken;
+		failed = broken.get_future();
+	}
+	REQUIRE(is_ready(failed));
+	REQUIRE_THROWS_AS(failed.get(), std::future_error);
+
+	Promise<int> throwing;
+	Future<int> thrown = throwing.get_future();
+	throwing.set_exception(std::make_exception_ptr(std::runtime_error("Oops")));
+	REQUIRE_THROWS_AS(thrown.get(), std::runtime_error);
+}
+
+TEST_CASE("store_in and get_if_ready work with the library's futures")
+{
+	auto task_queue = TaskQueue(1);
+
+	Future<int> future;
+	task_queue.push_task(task([]() { return 3; }).then(store_in(future)));
+	REQUIRE(get_if_ready(future) == std::nullopt);
+
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(get_if_ready(future) == 3);
+}
+
+TEST_CASE("when_all can join a number of tasks only known at run time")
+{
+	auto task_queue = TaskQueue(2);
+
+	auto const make_producer = [](int i) { return task([i]() { return i; }); };
+	std::vector<decltype(make_producer(0))> producers;
+	for (int i = 0; i < 100; ++i)
+		producers.push_back(make_producer(i));
+
+	std::vector<int> results;
+	auto tasks = when_all([&results](std::span<int> values) { results.assign(values.begin(), values.end()); }, task_queue, std::span(producers));
+	REQUIRE(tasks.size() == 100);
+
+	// Run in any order, results are still in the order of the producers.
+	for (auto it = tasks.rbegin(); it != tasks.rend(); ++it)
+		task_queue.push_task(std::move(*it));
+	this_thread::work_until_no_tasks_left_for(task_queue);
+
+	REQUIRE(results.size() == 100);
+	for (int i = 0; i < 100; ++i)
+		REQUIRE(results[i] == i);
+
+	// With nothing to wait for, f is scheduled right away.
+	bool called = false;
+	std::span<decltype(make_producer(0))> no_producers;
+	REQUIRE(when_all([&called](std::span<int> values) { called = values.empty(); }, task_queue, no_producers).empty());
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(called);
+}
+
+TEST_CASE("when_any calls its continuation with the first result only")
+{
+	auto task_queue = TaskQueue(1);
+
+	std::vector<int> calls;
+	auto [t1, t2, t3] = when_any([&calls](int i) { calls.push_back(i); }, task_queue,
+		task([]() { return 1; }),
+		task([]() { return 2; }),
+		task([]() { return 3; })
+	);
+
+	std::move(t2)();
+	std::move(t3)();
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(calls == std::vector<int>{2});
+
+	std::move(t1)();
+	REQUIRE(!task_queue.has_work_queued());
+	REQUIRE(calls == std::vector<int>{2});
+}
+
+TEST_CASE("when_n calls its continuation with the first n results")
+{
+	auto task_queue = TaskQueue(1);
+
+	std::vector<int> results;
+	auto [t1, t2, t3, t4] = when_n(2, [&results](std::span<int> values) { results.assign(values.begin(), values.end()); }, task_queue,
+		task([]() { return 1; }),
+		task([]() { return 2; }),
+		task([]() { return 3; }),
+		task([]() { return 4; })
+	);
+
+	std::move(t3)();
+	REQUIRE(!task_queue.has_work_queued());
+	std::move(t1)();
+	std::move(t4)();
+	std::move(t2)();
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(results == std::vector<int>{3, 1});
+}
+
+TEST_CASE("A task graph runs every node after its predecessors, as many times as needed")
+{
+	auto task_queue = TaskQueue(4);
+	auto workers = make_workers_for_queue(task_queue, 3);
+
+	// a -> b, a -> c, b -> d, c -> d, and e on its own.
+	std::mutex order_mutex;
+	std::vector<char> order;
+	auto const node = [&](char name) { return [&, name]() { auto const g = std::lock_guard(order_mutex); order.push_back(name); }; };
+
+	TaskGraph graph;
+	auto const a = graph.add_node(node('a'));
+	auto const b = graph.add_node(node('b'));
+	auto const c = graph.add_node(node('c'));
+	auto const d = graph.add_node(node('d'));
+	graph.add_node(node('e'));
+	graph.add_edge(a, b);
+	graph.add_edge(a, c);
+	graph.add_edge(b, d);
+	graph.add_edge(c, d);
+	graph.compile();
+
+	for (int run = 0; run < 3; ++run)
+	{
+		order.clear();
+		graph.run(task_queue);
+
+		REQUIRE(order.size() == 5);
+		auto const position = [&](char name) { return std::find(order.begin(), order.end(), name) - order.begin(); };
+		REQUIRE(position('a') < position('b'));
+		REQUIRE(position('a') < position('c'));
+		REQUIRE(position('b') < position('d'));
+		REQUIRE(position('c') < position('d'));
+		REQUIRE(position('e') < 5);
+	}
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("A task queue can store tasks with a bigger small buffer")
+{
+	using BigTask = BasicPolymorphicTask<128>;
+	std::string const first = "a fairly long string that is allocated on its own";
+	std::string const second = "and another one, just as long as the first one";
+	auto bound = task([](std::string const & a, std::string const & b) { return a.size() + b.size(); }, first, second);
+	static_assert(!PolymorphicTask::fits_small_buffer<decltype(bound)>);
+	static_assert(BigTask::fits_small_buffer<decltype(bound)>);
+
+	auto task_queue = BasicTaskQueue<BigTask>(2);
+	size_t result = 0;
+	task_queue.push_task([&result, bound = std::move(bound)]() mutable { result = std::move(bound)(); });
+
+	// Continuations are type erased straight into the task type of the executor.
+	std::atomic<int> chain_result = 0;
+	task_queue.push_task(task([]() { return 1; })
+		.then(continuation([](int x) { return x + 1; }, task_queue)
+			.then(continuation([&chain_result](int x) { chain_result = x * 10; }, task_queue))));
+
+	auto workers = make_workers_for_queue(task_queue, 2);
+	while (chain_result == 0)
+		std::this_thread::yield();
+	for (BasicWorkerThread<BigTask> & worker : workers)
+		worker.join();
+
+	REQUIRE(result == first.size() + second.size());
+	REQUIRE(chain_result == 20);
+}
+
+TEST_CASE("Big tasks reuse pooled memory, also when they are freed on another thread")
+{
+	auto const make_big_tasks = [](std::vector<PolymorphicTask> & tasks, int & counter)
+	{
+		for (int i = 0; i < 100; ++i)
+			tasks.push_back([&counter, padding = std::array<char, 100>()]() { counter += 1 + padding[0]; });
+	};
+
+	int counter = 0;
+	std::vector<PolymorphicTask> tasks;
+	make_big_tasks(tasks, counter);
+	tasks.clear();
+
+	// Freed locally.
+	auto const before_local = PooledTaskAllocator::stats();
+	make_big_tasks(tasks, counter);
+	auto const after_local = PooledTaskAllocator::stats();
+	REQUIRE(after_local.allocations - before_local.allocations == 100);
+	REQUIRE(after_local.pool_misses == before_local.pool_misses);
+
+	// Freed on another thread, they go back to this one.
+	std::thread([&tasks]() { for (PolymorphicTask & t : tasks) t(); tasks.clear(); }).join();
+	REQUIRE(counter == 100);
+	auto const after_remote = PooledTaskAllocator::stats();
+	REQUIRE(after_remote.remote_frees - after_local.remote_frees == 100);
+
+	make_big_tasks(tasks, counter);
+	auto const after_reuse = PooledTaskAllocator::stats();
+	REQUIRE(after_reuse.pool_misses == after_remote.pool_misses);
+}
+
+TEST_CASE("Tasks that are trivially relocatable keep their state when moved around")
+{
+	int sum = 0;
+	auto const add = [&sum, a = 1, b = 2, c = 3]() { sum += a + b + c; };
+	static_assert(is_trivially_relocatable<decltype(add)>);
+
+	PolymorphicTask first = add;
+	PolymorphicTask second = std::move(first);
+	PolymorphicTask third;
+	third = std::move(second);
+	REQUIRE(!first);
+	REQUIRE(!second);
+	third();
+	REQUIRE(sum == 6);
+
+	std::string text = "not trivially copyable, so moved through the virtual table";
+	static_assert(!is_trivially_relocatable<std::string>);
+	PolymorphicTask with_string = [&sum, text]() { sum += static_cast<int>(text.size()); };
+	PolymorphicTask moved = std::move(with_string);
+	moved();
+	REQUIRE(sum == 6 + static_cast<int>(text.size()));
+}
+
+TEST_CASE("Consuming a task runs it, destroys it and leaves it empty, also if it throws")
+{
+	auto const captured = std::make_shared<int>(0);
+
+	PolymorphicTask small = [captured]() { (*captured)++; };
+	PolymorphicTask big = [captured, padding = std::array<char, 100>()]() { (*captured) += 10 + padding[0]; };
+	REQUIRE(captured.use_count() == 3);
+
+	small.consume();
+	big.consume();
+	REQUIRE(*captured == 11);
+	REQUIRE(captured.use_count() == 1);
+	REQUIRE(!small);
+	REQUIRE(!big);
+
+	PolymorphicTask throwing = [captured]() { throw std::runtime_error("oops"); };
+	REQUIRE_THROWS_AS(throwing.consume(), std::runtime_error);
+	REQUIRE(captured.use_count() == 1);
+	REQUIRE(!throwing);
+}
+
+TEST_CASE("A worker registration doesn't outlive its queue and never gives an index out of bounds")
+{
+	{
+		auto old_queue = TaskQueue(4);
+		this_thread::register_as_worker(old_queue, 3);
+		REQUIRE(this_thread::worker_queue_index(old_queue) == 3);
+	}
+	// Likely to be at the same address as the old one.
+	auto new_queue = TaskQueue(1);
+	REQUIRE(!this_thread::worker_queue_index(new_queue));
+	new_queue.push_task([]() {});
+	REQUIRE(this_thread::work_until_no_tasks_left_for(new_queue) == 1);
+
+	this_thread::register_as_worker(new_queue, 5);
+	REQUIRE(this_thread::worker_queue_index(new_queue) == 0);
+	this_thread::unregister_as_worker();
+}
+
+TEST_CASE("A task that waits for another task of the same single worker pool doesn't deadlock")
+{
+	for (int i = 0; i < 20; ++i)
+	{
+		auto task_queue = TaskQueue(1);
+
+		// Queued before the worker starts, so that it finds all three at once.
+		task_queue.push_task([]() {});
+		Future<int> inner = async(task_queue, task([]() { return 7; }));
+		Future<int> outer = async(task_queue, task([&inner, &task_queue]() { return this_thread::wait_for(inner, task_queue) * 3; }));
+
+		auto workers = make_workers_for_queue(task_queue, 1);
+		REQUIRE(HelpingFuture(std::move(outer), task_queue).get() == 21);
+		for (WorkerThread & worker : workers)
+			worker.join();
+	}
+}
+
+namespace
+{
+	auto triple_of_async(TaskQueue & task_queue) -> CoTask<int>
+	{
+		co_await schedule_on(task_queue);
+		Future<int> future = async(task_queue, task([]() { return 5; }));
+		int const i = co_await resume_when_ready(future, task_queue);
+		co_return i * 3;
+	}
+}
+
+TEST_CASE("A coroutine awaiting a Future on a single worker lets the task that sets it run")
+{
+	auto task_queue = TaskQueue(1);
+	auto workers = make_workers_for_queue(task_queue, 1);
+
+	// Plain wait, so only the worker runs tasks.
+	Future<int> result = async(task_queue, triple_of_async(task_queue));
+	REQUIRE(result.get() == 15);
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("Big tasks that need more alignment than a pooled block get it")
+{
+	struct alignas(64) Aligned
+	{
+		std::array<char, 64> bytes = {};
+	};
+
+	for (int i = 0; i < 8; ++i)
+	{
+		void * const memory = PooledTaskAllocator::allocate(64 * (i + 1), 64);
+		REQUIRE(reinterpret_cast<uintptr_t>(memory) % 64 == 0);
+		PooledTaskAllocator::deallocate(memory, 64 * (i + 1), 64);
+	}
+
+	bool aligned = false;
+	PolymorphicTask t = [&aligned, a = Aligned()]() { aligned = reinterpret_cast<uintptr_t>(&a) % 64 == 0; };
+	t();
+	REQUIRE(aligned);
+}
+
+TEST_CASE("A strand keeps running tasks after one of them throws")
+{
+	auto task_queue = TaskQueue(1);
+	auto strand = Strand(task_queue);
+
+	std::vector<int> order;
+	strand.run_task([&order]() { order.push_back(1); });
+	strand.run_task([]() { throw std::runtime_error("oops"); });
+	strand.run_task([&order]() { order.push_back(2); });
+
+	REQUIRE_THROWS_AS(this_thread::work_until_no_tasks_left_for(task_queue), std::runtime_error);
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(order == std::vector<int>{1, 2});
+
+	strand.run_task([&order]() { order.push_back(3); });
+	this_thread::work_until_no_tasks_left_for(task_queue);
+	REQUIRE(order == std::vector<int>{1, 2, 3});
+}
+
+TEST_CASE("A task graph with a node that throws finishes and rethrows, and can run again")
+{
+	auto task_queue = TaskQueue(2);
+	auto workers = make_workers_for_queue(task_queue, 2);
+
+	std::atomic<int> runs = 0;
+	bool should_throw = true;
+	TaskGraph graph;
+	auto const a = graph.add_node([&]() { runs++; if (should_throw) throw std::runtime_error("oops"); });
+	auto const b = graph.add_node([&]() { runs++; });
+	auto const c = graph.add_node([&]() { runs++; });
+	graph.add_edge(a, b);
+	graph.add_edge(b, c);
+
+	REQUIRE_THROWS_AS(graph.run(task_queue), std::runtime_error);
+	REQUIRE(runs == 1);
+
+	should_throw = false;
+	graph.run(task_queue);
+	REQUIRE(runs == 4);
+
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
+
+TEST_CASE("Cancelling a timer takes it out of the timer queue and destroys its task right away")
+{
+	auto task_queue = TaskQueue(1);
+	auto timers = TimerQueue(task_queue);
+
+	auto const captured = std::make_shared<int>(0);
+	std::vector<TimerQueue::TimerId> ids;
+	for (int i = 0; i < 100; ++i)
+		ids.push_back(timers.run_task_after([captured]() { (*captured)++; }, std::chrono::hours(1 + i % 7)));
+	auto const kept = timers.run_task_after([]() {}, std::chrono::hours(2));
+	REQUIRE(timers.number_of_pending_timers() == 101);
+	REQUIRE(captured.use_count() == 101);
+
+	// Out of order, so that timers are taken out of the middle of the heap too.
+	for (int i = 0; i < 100; i += 2)
+		REQUIRE(timers.cancel(ids[i]));
+	for (int i = 1; i < 100; i += 2)
+		REQUIRE(timers.cancel(ids[i]));
+	REQUIRE(timers.number_of_pending_timers() == 1);
+	REQUIRE(captured.use_count() == 1);
+	REQUIRE(timers.cancel(kept));
+	REQUIRE(timers.number_of_pending_timers() == 0);
+}
+
+TEST_CASE("An empty topology falls back to the rotation steal order and unpinned workers")
+{
+	auto const empty = CpuTopology({});
+	REQUIRE(make_steal_orders(empty, 3) == make_rotation_steal_orders(3));
+	REQUIRE(make_rotation_steal_orders(3) == std::vector<std::vector<int>>{{1, 2}, {2, 0}, {0, 1}});
+	REQUIRE(!CpuTopology::detect().cpus.empty());
+
+	auto task_queue = TaskQueue(2);
+	auto workers = make_workers_for_queue(task_queue, empty, 2);
+	std::atomic<int> done = 0;
+	for (int i = 0; i < 10; ++i)
+		task_queue.push_task([&done]() { done++; });
+
+	// Steal orders may change under running workers.
+	task_queue.set_steal_orders(make_rotation_steal_orders(2));
+
+	while (done < 10)
+		std::this_thread::yield();
+	for (WorkerThread & worker : workers)
+		worker.join();
+}
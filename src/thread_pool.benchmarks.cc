@@ -0,0 +1,157 @@
+#include "thread_pool.hh"
+#include "catch/catch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <queue>
+#include <vector>
+
+// Hidden from the default run, since timings are only meaningful in an optimized build on an otherwise
+// idle machine. Run them with the [benchmark] tag.
+
+namespace
+{
+	// Best of a few runs, in nanoseconds per operation.
+	template <typename F>
+	auto measure(int operation_count, F f) -> double
+	{
+		double best = std::numeric_limits<double>::max();
+		for (int run = 0; run < 9; ++run)
+		{
+			auto const start = std::chrono::steady_clock::now();
+			f();
+			auto const end = std::chrono::steady_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / operation_count);
+		}
+		return best;
+	}
+} // namespace
+
+TEST_CASE("Fan out throughput at different thread counts", "[.][benchmark]")
+{
+	// Every root task pushes its children from a worker, so most pushes go to the worker's own deque
+	// and the rest of the threads have to steal. To compare two versions, run this on both on the same
+	// many core machine.
+	constexpr int root_count = 2000;
+	constexpr int children_per_root = 50;
+	constexpr int task_count = root_count * (children_per_root + 1);
+	int const cpu_count = static_cast<int>(std::thread::hardware_concurrency());
+
+	for (int const thread_count : {1, 4, 16, 64})
+	{
+		// More threads than CPUs measures the cost of time slicing them, not how the queue scales.
+		if (thread_count > cpu_count)
+		{
+			std::printf("%2d threads: skipped, only %d CPUs\n", thread_count, cpu_count);
+			continue;
+		}
+
+		std::atomic<int> tasks_run = 0;
+		double const ns_per_task = measure(task_count, [&]()
+		{
+			auto task_queue = TaskQueue(thread_count);
+			auto workers = make_workers_for_queue(task_queue, thread_count);
+			for (int i = 0; i < root_count; ++i)
+			{
+				task_queue.push_task([&task_queue, &tasks_run]()
+				{
+					for (int j = 0; j < children_per_root; ++j)
+						task_queue.push_task([&tasks_run]() { tasks_run.fetch_add(1, std::memory_order_relaxed); });
+					tasks_run.fetch_add(1, std::memory_order_relaxed);
+				});
+			}
+			for (WorkerThread & worker : workers)
+				worker.join();
+		});
+		CHECK(tasks_run == task_count * 9);
+		std::printf("%2d threads: %.1f M tasks/s\n", thread_count, 1000.0 / ns_per_task);
+	}
+}
+
+namespace
+{
+	// Same size and same work as the lambda in the benchmark below, but the move constructor makes it
+	// not trivially relocatable, so PolymorphicTask moves it through its virtual table.
+	struct AddWithMoveConstructor
+	{
+		int * sum;
+		int i;
+
+		AddWithMoveConstructor(int * sum_, int i_) : sum(sum_), i(i_) {}
+		AddWithMoveConstructor(AddWithMoveConstructor && other) noexcept : sum(other.sum), i(other.i) {}
+
+		auto operator()() const -> void { *sum += i; }
+	};
+	static_assert(!is_trivially_relocatable<AddWithMoveConstructor>);
+
+	struct PushPopTimes
+	{
+		double task_queue_ns;
+		double std_queue_ns;
+		double move_ns;
+	};
+
+	template <typename MakeTask>
+	auto measure_push_pop(MakeTask make_task) -> PushPopTimes
+	{
+		constexpr int task_count = 2'000'000;
+		PushPopTimes times;
+
+		auto task_queue = TaskQueue(1);
+		times.task_queue_ns = measure(task_count, [&]()
+		{
+			for (int i = 0; i < task_count; ++i)
+			{
+				task_queue.push_task(make_task(i), 0);
+				std::optional<PolymorphicTask> task = task_queue.pop_task(0);
+				(*task)();
+			}
+		});
+		CHECK(task_queue.number_of_queued_tasks() == 0);
+
+		std::queue<PolymorphicTask> std_queue;
+		times.std_queue_ns = measure(task_count, [&]()
+		{
+			for (int i = 0; i < task_count; ++i)
+			{
+				std_queue.push(make_task(i));
+				std::optional<PolymorphicTask> task = std::move(std_queue.front());
+				std_queue.pop();
+				(*task)();
+			}
+		});
+
+		// Moves back and forth between two buffers, without running anything.
+		std::vector<PolymorphicTask> from(256), to(256);
+		for (PolymorphicTask & task : from)
+			task = make_task(1);
+		times.move_ns = measure(task_count, [&]()
+		{
+			for (int i = 0; i < task_count / 256; ++i)
+			{
+				std::move(from.begin(), from.end(), to.begin());
+				std::swap(from, to);
+			}
+		});
+		return times;
+	}
+} // namespace
+
+TEST_CASE("Single threaded push and pop cost of a small task", "[.][benchmark]")
+{
+	// A lambda that captures a reference and an int fits in the small buffer and is trivially
+	// relocatable, so moving it is a copy of the buffer. The same task with a move constructor shows
+	// what that saves.
+	int sum = 0;
+	PushPopTimes const relocated = measure_push_pop([&sum](int i) { return [&sum, i]() { sum += i; }; });
+	PushPopTimes const moved = measure_push_pop([&sum](int i) { return AddWithMoveConstructor(&sum, i); });
+
+	auto const print = [](char const * name, PushPopTimes const & times)
+	{
+		std::printf("%s: TaskQueue push and pop %.1f ns, std::queue push and pop %.1f ns, move assignment %.2f ns\n",
+			name, times.task_queue_ns, times.std_queue_ns, times.move_ns);
+	};
+	print("memcpy       ", relocated);
+	print("virtual table", moved);
+}
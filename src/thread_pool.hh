@@ -1,6 +1,10 @@
 #pragma once
 
 #include "polymorphic_task.hh"
+#include "task.hh"
+#include "topology.hh"
+#include "parker.hh"
+#include "cache_line.hh"
 #include <vector>
 #include <mutex>
 #include <atomic>
@@ -8,6 +12,10 @@
 #include <functional>
 #include <optional>
 #include <span>
+#include <array>
+#include <memory>
+#include <thread>
+#include <cstdint>
 
 struct atomic_flag_lock_guard
 {
@@ -24,63 +32,251 @@ private:
 	bool locked;
 };
 
-struct TaskQueue
+// How a queue that ran out of tasks picks which other queue to steal from. Linear always sweeps
+// the others in steal order. Random starts the sweep at a random point of it, so that idle threads
+// don't all hit the same neighbours. Power of two choices looks at two random queues and starts at
+// the one with more tasks.
+enum class StealPolicy { linear, random, power_of_two_choices };
+
+// Task is the type erased task type that the queue stores, usually an instance of BasicPolymorphicTask.
+// Every slot of the queue is the size of a Task. Tasks are run with consume.
+template <typename Task>
+struct BasicTaskQueue
 {
-	explicit TaskQueue(int queue_count);
+	explicit BasicTaskQueue(int queue_count, StealPolicy steal_policy = StealPolicy::linear);
+	// Unregisters the calling thread if it is a worker of this queue. Other workers should be joined
+	// or moved to another queue before.
+	~BasicTaskQueue();
+
+	BasicTaskQueue(BasicTaskQueue const &) = delete;
+	BasicTaskQueue & operator = (BasicTaskQueue const &) = delete;
+
+	// Pushes to the queue of the calling thread if it is registered as a worker of this queue.
+	// Otherwise picks a queue in round robin.
+	auto push_task(Task task, TaskPriority priority = TaskPriority::normal) -> void;
+	auto push_task(Task task, int preferred_queue_index, TaskPriority priority = TaskPriority::normal) -> int;
+
+	// Pushes all tasks to the same queue, paying for synchronization once for the whole batch.
+	// Tasks are moved from.
+	auto push_tasks(std::span<Task> tasks, TaskPriority priority = TaskPriority::normal) -> void;
+	auto push_tasks(std::span<Task> tasks, int preferred_queue_index, TaskPriority priority = TaskPriority::normal) -> int;
+
+	// The task is only ever popped by threads that pop with worker_index as their preferred queue,
+	// before any other task and in the order they were pushed. To run tasks on the main thread, make
+	// a queue for it and pump it from there with that index.
+	auto push_task_pinned(Task task, int worker_index) -> void;
+
+	// Tasks of a higher priority are always popped before any task of a lower priority.
+	auto pop_task(int preferred_queue_index) -> std::optional<Task>;
 
-	auto push_task(PolymorphicTask task) -> void;
-	auto push_task(PolymorphicTask task, int preferred_queue_index) -> int;
+	// Pops up to out.size() tasks of the same priority into out and returns how many it popped.
+	// Takes at most half of the tasks in the preferred queue so that there is something left for
+	// others to steal. If the preferred queue is empty it steals a single task like pop_task.
+	auto pop_tasks(int preferred_queue_index, std::span<Task> out) -> int;
 
-	auto pop_task(int preferred_queue_index) -> std::optional<PolymorphicTask>;
+	// Parks the calling thread on the given parker until a task is pushed to the queue. Each push
+	// wakes at most one parked thread. Returns immediately if there is already work queued. A
+	// registered worker is also woken by tasks pinned to it.
+	auto wait_for_work(Parker & parker) -> void;
 
-	// To make it satisfy the executor concept.
-	auto run_task(PolymorphicTask task) -> void { push_task(std::move(task)); }
+	// The order in which each queue visits the others when it has to steal. Defaults to starting
+	// from the next queue. Safe to call while other threads pop, they pick the new orders up on their
+	// next steal.
+	auto set_steal_orders(std::vector<std::vector<int>> orders) -> void;
 
-	auto number_of_queues() const noexcept -> int { return static_cast<int>(queues.size()); }
-	auto number_of_queued_tasks() const noexcept -> int { return queued_tasks; }
-	auto has_work_queued() const noexcept -> bool { return number_of_queued_tasks() > 0; }
+	// To make it satisfy the executor concepts.
+	auto run_task(Task task) -> void { push_task(std::move(task)); }
+	auto run_task(Task task, TaskPriority priority) -> void { push_task(std::move(task), priority); }
+
+	auto number_of_queues() const noexcept -> int { return queue_count; }
+	// Unique among every queue ever created, even one made at the address of a destroyed queue.
+	auto id() const noexcept -> uint64_t { return queue_id; }
+	// There is no shared counter of tasks, so these add up the sizes of every queue. The result is
+	// approximate while other threads are pushing or popping. Pinned tasks have no priority, so only
+	// the overload without one counts them.
+	auto number_of_queued_tasks() const noexcept -> int;
+	auto number_of_queued_tasks(TaskPriority priority) const noexcept -> int;
+	auto has_work_queued() const noexcept -> bool;
+	auto number_of_pinned_tasks(int worker_index) const noexcept -> int;
+	// Only looks at the deques and the pinned tasks of the calling worker, so it costs a few loads
+	// instead of a scan of every queue. Falls back to has_work_queued() when called from a thread that
+	// isn't a worker.
+	auto has_local_work_queued() const noexcept -> bool;
+	auto number_of_parked_threads() const noexcept -> int { return parked_thread_count; }
 
 private:
-	struct LockQueue
+	// Chase-Lev work stealing deque. The thread that holds the owner flag pushes and takes from the
+	// bottom in LIFO order without contending with anyone else, while any thread may steal from the
+	// top in FIFO order with a single compare and swap. Ownership is taken with a try lock instead of
+	// being tied to a thread so that any thread may push to or drain any deque. Workers are the only
+	// ones that take the flag of their preferred deque on every pop, so it usually stays in their cache.
+	// Aligned so that deques next to each other in a vector don't share cache lines.
+	struct alignas(cache_line_size) WorkStealingDeque
 	{
-		auto push(PolymorphicTask && task) -> bool;
-		auto pop() -> std::optional<PolymorphicTask>;
+		WorkStealingDeque();
+
+		// Owner operations. Must only be called while holding owner_flag.
+		auto push(Task && task) -> void;
+		auto take() -> std::optional<Task>;
+
+		// Approximate unless called by the owner.
+		auto size() const noexcept -> int;
+		// Cheap check without fences. May miss a task that is being pushed at the same time.
+		auto looks_empty() const noexcept -> bool;
+
+		// Sets contended if it lost a race against another thread, in which case the deque may
+		// still have tasks even if nothing was returned.
+		auto steal(bool & contended) -> std::optional<Task>;
+
+		auto has_overflow() const noexcept -> bool { return overflow_size.load(std::memory_order_relaxed) > 0; }
+
+		// Written on every operation of the owner, so it gets its own cache line.
+		alignas(cache_line_size) std::atomic_flag owner_flag;
 
 	private:
-		std::queue<PolymorphicTask> queue;
-		std::atomic_flag mutex;
+		static constexpr int64_t capacity = 256;
+		static_assert((capacity & (capacity - 1)) == 0, "Capacity must be a power of two.");
+
+		struct Slot
+		{
+			Task task;
+			// Cleared by whoever moves the task out. Owner only reuses a slot once it is clear, which
+			// protects it from a thief that has claimed it but hasn't finished moving the task out yet.
+			std::atomic<bool> full = false;
+		};
+
+		// Tasks that didn't fit in the ring. They are newer than anything in the ring so they are
+		// taken first. Only accessed by the owner.
+		std::vector<Task> overflow;
+		std::atomic<int> overflow_size = 0;
+
+		// Read by everyone, never written after construction.
+		alignas(cache_line_size) std::unique_ptr<Slot[]> ring;
+
+		// Written by thieves and by the owner respectively.
+		alignas(cache_line_size) std::atomic<int64_t> top = 0;
+		alignas(cache_line_size) std::atomic<int64_t> bottom = 0;
 	};
 
-	std::vector<LockQueue> queues;
-	int round_robin_next_index = 0;
-	std::atomic<int> queued_tasks;
+	// Tasks pinned to a worker. Rare enough that a mutex is fine, size lets owners skip it when empty.
+	struct alignas(cache_line_size) PinnedInbox
+	{
+		std::mutex mutex;
+		std::queue<Task> tasks;
+		std::atomic<int> size = 0;
+	};
+
+	struct ParkedThread
+	{
+		Parker * parker;
+		// Of the worker, or nullopt if the thread isn't registered as one.
+		std::optional<int> queue_index;
+	};
+
+	// One deque per queue index for each priority.
+	struct PriorityBand
+	{
+		std::vector<WorkStealingDeque> queues;
+	};
+
+	auto band(TaskPriority priority) noexcept -> PriorityBand & { return bands[static_cast<int>(priority)]; }
+	auto band(TaskPriority priority) const noexcept -> PriorityBand const & { return bands[static_cast<int>(priority)]; }
+
+	auto pop_task_from(PriorityBand & band, int preferred_queue_index) -> std::optional<Task>;
+	auto pop_pinned_tasks(int worker_index, std::span<Task> out) -> int;
+	// Whether any deque has a task, that is, one that any thread could pop.
+	auto has_stealable_work_queued() const noexcept -> bool;
+	auto pick_first_victim(PriorityBand const & band, std::vector<int> const & steal_order) const noexcept -> int;
+	auto take_from(WorkStealingDeque & deque, bool & contended) -> std::optional<Task>;
+	auto wake_parked_threads(int count) -> void;
+
+	uint64_t queue_id;
+	int queue_count;
+	StealPolicy steal_policy;
+	std::array<PriorityBand, number_of_task_priorities> bands;
+	std::atomic<unsigned> round_robin_next_index = 0;
+	// Read on every steal without a lock. Replaced orders are kept until the queue is destroyed, as
+	// another thread may still be going through them. They are replaced rarely, if ever.
+	using StealOrders = std::vector<std::vector<int>>;
+	std::atomic<StealOrders const *> steal_orders = nullptr;
+	std::mutex steal_orders_mutex;
+	std::vector<std::unique_ptr<StealOrders const>> all_steal_orders;
+	std::vector<PinnedInbox> pinned_inboxes;
+
+	std::mutex parked_threads_mutex;
+	std::vector<ParkedThread> parked_threads;
+	std::atomic<int> parked_thread_count = 0;
+};
+
+using TaskQueue = BasicTaskQueue<PolymorphicTask>;
+
+constexpr int default_idle_spin_budget = 64;
+
+// What a worker does when its work source runs dry. It retries spin_budget times, yielding in
+// between, and then calls park, which should block on the parker until there may be work again.
+// Without a park function the worker just keeps yielding.
+struct IdleStrategy
+{
+	int spin_budget = default_idle_spin_budget;
+	std::function<void(Parker &)> park;
 };
 
-inline auto as_work_source(TaskQueue & queue, int preferred_queue_index);
+template <typename Task>
+auto as_work_source(BasicTaskQueue<Task> & queue, int preferred_queue_index);
+template <typename Task>
+auto as_idle_strategy(BasicTaskQueue<Task> & queue, int spin_budget = default_idle_spin_budget) -> IdleStrategy;
 
 namespace this_thread
 {
-	auto perform_task_for(TaskQueue & task_queue) -> bool;
-	auto perform_task_for(TaskQueue & task_queue, int preferred_queue_index) -> bool;
+	// Registers the calling thread as the worker of the given queue index. Work sources made with
+	// as_work_source do this on their own.
+	template <typename Task>
+	auto register_as_worker(BasicTaskQueue<Task> & task_queue, int queue_index) noexcept -> void;
+	inline auto unregister_as_worker() noexcept -> void;
+	template <typename Task>
+	auto worker_queue_index(BasicTaskQueue<Task> const & task_queue) noexcept -> std::optional<int>;
+
+	template <typename Task>
+	auto perform_task_for(BasicTaskQueue<Task> & task_queue) -> bool;
+	template <typename Task>
+	auto perform_task_for(BasicTaskQueue<Task> & task_queue, int preferred_queue_index) -> bool;
+
+	template <typename Task>
+	auto work_until_no_tasks_left_for(BasicTaskQueue<Task> & task_queue) -> int;
+	template <typename Task>
+	auto work_until_no_tasks_left_for(BasicTaskQueue<Task> & task_queue, int preferred_queue_index) -> int;
+}
 
-	auto work_until_no_tasks_left_for(TaskQueue & task_queue) -> int;
-	auto work_until_no_tasks_left_for(TaskQueue & task_queue, int preferred_queue_index) -> int;
+namespace detail
+{
+	// xorshift32 with its state in a thread local, which is much cheaper than a random_device. Only
+	// used to spread threads over queues, so quality doesn't matter much.
+	auto thread_local_random() noexcept -> uint32_t;
+	// Never returns 0, which stands for no queue.
+	auto next_task_queue_id() noexcept -> uint64_t;
 }
 
-struct WorkerThread
+// Runs tasks of type Task, which must match the task type of the queue it works for.
+template <typename Task>
+struct BasicWorkerThread
 {
-	using WorkSource = std::function<std::optional<PolymorphicTask>()>;
+	// Fills the given buffer with up to its size tasks and returns how many it filled. Workers ask for
+	// one task at a time.
+	using WorkSource = std::function<int(std::span<Task>)>;
+
+	BasicWorkerThread(WorkSource work_source, IdleStrategy idle_strategy = IdleStrategy());
+	~BasicWorkerThread();
 
-	WorkerThread(WorkSource work_source);
-	~WorkerThread();
+	BasicWorkerThread(BasicWorkerThread const &) = delete;
+	BasicWorkerThread & operator = (BasicWorkerThread const &) = delete;
 
-	WorkerThread(WorkerThread const &) = delete;
-	WorkerThread & operator = (WorkerThread const &) = delete;
+	BasicWorkerThread(BasicWorkerThread && other) noexcept;
+	BasicWorkerThread & operator = (BasicWorkerThread &&) noexcept;
 
-	WorkerThread(WorkerThread && other) noexcept;
-	WorkerThread & operator = (WorkerThread &&) noexcept;
+	auto work_for(WorkSource source, IdleStrategy idle_strategy = IdleStrategy()) -> void;
 
-	auto work_for(WorkSource source) -> void;
+	// Restricts the worker to run only on the given logical CPU. Returns false if it couldn't.
+	auto pin_to_cpu(int cpu_id) -> bool { return pin_thread_to_cpu(thread, cpu_id); }
 
 	auto join() -> void;
 
@@ -92,18 +288,37 @@ private:
 	{
 		std::mutex work_source_mutex;
 		WorkSource work_source;
-		bool stop_token = false;
-		bool work_source_changed = false;
+		IdleStrategy idle_strategy;
+		Parker parker;
+		std::atomic<bool> stop_token = false;
+		std::atomic<bool> work_source_changed = false;
 	};
 
-	static auto worker_main(WorkerState * & state_ptr, WorkSource initial_work_source) -> void;
+	static auto worker_main(WorkerState * & state_ptr, WorkSource initial_work_source, IdleStrategy initial_idle_strategy) -> void;
 
-	std::thread thread;
+	// Must be declared before thread. The worker sets it as soon as it starts, which may happen
+	// before the constructor would get to initialize it otherwise.
 	WorkerState * state = nullptr;
+	std::thread thread;
 };
 
-auto make_workers_for_queue(TaskQueue & task_queue) -> std::vector<WorkerThread>;
-auto make_workers_for_queue(TaskQueue & task_queue, int worker_count) -> std::vector<WorkerThread>;
-auto assign_thread_pool_to_workers(std::span<WorkerThread> workers, TaskQueue & task_queue) -> void;
+using WorkerThread = BasicWorkerThread<PolymorphicTask>;
+
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & task_queue) -> std::vector<BasicWorkerThread<Task>>;
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & task_queue, int worker_count) -> std::vector<BasicWorkerThread<Task>>;
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & task_queue, int worker_count, int idle_spin_budget) -> std::vector<BasicWorkerThread<Task>>;
+// One worker per logical CPU of the topology, each pinned to its CPU, and the queue set to steal
+// from the queues of closer CPUs first. The queue should have at least as many queues as the
+// topology has CPUs. If a worker can't be pinned the queue keeps the default steal order, and an
+// empty topology makes unpinned workers.
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & task_queue, CpuTopology const & topology) -> std::vector<BasicWorkerThread<Task>>;
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & task_queue, CpuTopology const & topology, int worker_count) -> std::vector<BasicWorkerThread<Task>>;
+template <typename Task>
+auto assign_thread_pool_to_workers(std::type_identity_t<std::span<BasicWorkerThread<Task>>> workers, BasicTaskQueue<Task> & task_queue) -> void;
 
 #include "thread_pool.inl"
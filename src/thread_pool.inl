@@ -1,10 +1,738 @@
-inline auto as_work_source(TaskQueue & queue, int preferred_queue_index)
+#include <cassert>
+#include <algorithm>
+
+template <typename Task>
+auto as_work_source(BasicTaskQueue<Task> & queue, int preferred_queue_index)
 {
 	// Avoid out of bounds indices.
 	int const actual_index = preferred_queue_index % queue.number_of_queues();
 
-	return [&queue, actual_index]()
+	return [&queue, actual_index](std::span<Task> batch)
 	{
-		return queue.pop_task(actual_index);
+		this_thread::register_as_worker(queue, actual_index);
+		return queue.pop_tasks(actual_index, batch);
 	};
 }
+
+template <typename Task>
+auto as_idle_strategy(BasicTaskQueue<Task> & queue, int spin_budget) -> IdleStrategy
+{
+	return IdleStrategy{spin_budget, [&queue](Parker & parker) { queue.wait_for_work(parker); }};
+}
+
+namespace this_thread
+{
+	namespace detail
+	{
+		struct WorkerRegistration
+		{
+			// An id rather than an address, so that a queue created where a destroyed one used to be
+			// doesn't inherit its workers. Type erased so that queues of every task type share it.
+			uint64_t task_queue_id = 0;
+			int queue_index = 0;
+		};
+		inline thread_local WorkerRegistration worker_registration;
+	} // namespace detail
+
+	template <typename Task>
+	auto register_as_worker(BasicTaskQueue<Task> & task_queue, int queue_index) noexcept -> void
+	{
+		detail::worker_registration = {task_queue.id(), queue_index};
+	}
+
+	inline auto unregister_as_worker() noexcept -> void
+	{
+		detail::worker_registration = {};
+	}
+
+	template <typename Task>
+	auto worker_queue_index(BasicTaskQueue<Task> const & task_queue) noexcept -> std::optional<int>
+	{
+		if (detail::worker_registration.task_queue_id == task_queue.id())
+			return detail::worker_registration.queue_index % task_queue.number_of_queues();
+		else
+			return std::nullopt;
+	}
+}
+
+template <typename Task>
+BasicTaskQueue<Task>::BasicTaskQueue(int queue_count_, StealPolicy steal_policy_)
+	: queue_id(::detail::next_task_queue_id())
+	, queue_count(queue_count_)
+	, steal_policy(steal_policy_)
+{
+	assert(queue_count > 0);
+
+	for (PriorityBand & b : bands)
+		b.queues = std::vector<WorkStealingDeque>(queue_count);
+
+	pinned_inboxes = std::vector<PinnedInbox>(queue_count);
+
+	set_steal_orders(make_rotation_steal_orders(queue_count));
+}
+
+template <typename Task>
+BasicTaskQueue<Task>::~BasicTaskQueue()
+{
+	if (this_thread::worker_queue_index(*this))
+		this_thread::unregister_as_worker();
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::set_steal_orders(std::vector<std::vector<int>> orders) -> void
+{
+	assert(static_cast<int>(orders.size()) == queue_count);
+	auto const g = std::lock_guard(steal_orders_mutex);
+	all_steal_orders.push_back(std::make_unique<StealOrders const>(std::move(orders)));
+	steal_orders.store(all_steal_orders.back().get(), std::memory_order_release);
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::push_task(Task task, TaskPriority priority) -> void
+{
+	if (auto const own_index = this_thread::worker_queue_index(*this))
+		push_task(std::move(task), *own_index, priority);
+	else
+		push_task(std::move(task), round_robin_next_index.fetch_add(1, std::memory_order_relaxed) % number_of_queues(), priority);
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::push_task(Task task, int preferred_queue_index, TaskPriority priority) -> int
+{
+	PriorityBand & b = band(priority);
+	int const n = number_of_queues();
+	for (int i = preferred_queue_index; true; i = (i + 1) % n)
+	{
+		if (auto const g = atomic_flag_lock_guard(b.queues[i].owner_flag))
+		{
+			b.queues[i].push(std::move(task));
+			// Pairs with the fence in wait_for_work. Either we see the parked thread here or it sees
+			// the new task before going to sleep.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (parked_thread_count > 0)
+				wake_parked_threads(1);
+			return i;
+		}
+	}
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::push_tasks(std::span<Task> tasks, TaskPriority priority) -> void
+{
+	if (auto const own_index = this_thread::worker_queue_index(*this))
+		push_tasks(tasks, *own_index, priority);
+	else
+		push_tasks(tasks, round_robin_next_index.fetch_add(1, std::memory_order_relaxed) % number_of_queues(), priority);
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::push_tasks(std::span<Task> tasks, int preferred_queue_index, TaskPriority priority) -> int
+{
+	PriorityBand & b = band(priority);
+	int const n = number_of_queues();
+	int const task_count = static_cast<int>(tasks.size());
+	for (int i = preferred_queue_index; true; i = (i + 1) % n)
+	{
+		if (auto const g = atomic_flag_lock_guard(b.queues[i].owner_flag))
+		{
+			for (Task & task : tasks)
+				b.queues[i].push(std::move(task));
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (parked_thread_count > 0)
+				wake_parked_threads(task_count);
+			return i;
+		}
+	}
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::push_task_pinned(Task task, int worker_index) -> void
+{
+	assert(worker_index >= 0 && worker_index < queue_count);
+	PinnedInbox & inbox = pinned_inboxes[worker_index];
+	{
+		auto const g = std::lock_guard(inbox.mutex);
+		inbox.tasks.push(std::move(task));
+		inbox.size++;
+	}
+
+	// Pairs with the fence in wait_for_work, like in push_task. Only the worker the task is pinned
+	// to can run it, so wake that one.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parked_thread_count > 0)
+	{
+		auto const g = std::lock_guard(parked_threads_mutex);
+		auto const it = std::find_if(parked_threads.begin(), parked_threads.end(), [worker_index](ParkedThread const & parked)
+		{
+			return parked.queue_index == worker_index;
+		});
+		if (it != parked_threads.end())
+		{
+			it->parker->unpark();
+			parked_threads.erase(it);
+			parked_thread_count--;
+		}
+	}
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::pop_pinned_tasks(int worker_index, std::span<Task> out) -> int
+{
+	assert(worker_index >= 0 && worker_index < queue_count);
+	PinnedInbox & inbox = pinned_inboxes[worker_index];
+	if (inbox.size == 0)
+		return 0;
+
+	auto const g = std::lock_guard(inbox.mutex);
+	int popped = 0;
+	for (; popped < static_cast<int>(out.size()) && !inbox.tasks.empty(); ++popped)
+	{
+		out[popped] = std::move(inbox.tasks.front());
+		inbox.tasks.pop();
+	}
+	inbox.size -= popped;
+	return popped;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::pop_task(int preferred_queue_index) -> std::optional<Task>
+{
+	Task pinned;
+	if (pop_pinned_tasks(preferred_queue_index, std::span(&pinned, 1)) > 0)
+		return pinned;
+
+	for (PriorityBand & b : bands)
+		if (auto task = pop_task_from(b, preferred_queue_index))
+			return task;
+
+	return std::nullopt;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::pop_tasks(int preferred_queue_index, std::span<Task> out) -> int
+{
+	if (out.empty())
+		return 0;
+
+	if (int const pinned = pop_pinned_tasks(preferred_queue_index, out))
+		return pinned;
+
+	for (PriorityBand & b : bands)
+	{
+		int popped = 0;
+		WorkStealingDeque & own = b.queues[preferred_queue_index];
+		if (auto const g = atomic_flag_lock_guard(own.owner_flag))
+		{
+			int const half = (own.size() + 1) / 2;
+			int const to_pop = std::min(half, static_cast<int>(out.size()));
+			for (; popped < to_pop; ++popped)
+			{
+				auto task = own.take();
+				if (!task)
+					break;
+				out[popped] = std::move(*task);
+			}
+		}
+
+		if (popped > 0)
+			return popped;
+
+		if (auto task = pop_task_from(b, preferred_queue_index))
+		{
+			out[0] = std::move(*task);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::number_of_queued_tasks() const noexcept -> int
+{
+	int total = 0;
+	for (int priority = 0; priority < number_of_task_priorities; ++priority)
+		total += number_of_queued_tasks(static_cast<TaskPriority>(priority));
+	for (PinnedInbox const & inbox : pinned_inboxes)
+		total += inbox.size.load(std::memory_order_relaxed);
+	return total;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::number_of_queued_tasks(TaskPriority priority) const noexcept -> int
+{
+	int total = 0;
+	for (WorkStealingDeque const & deque : band(priority).queues)
+		total += deque.size();
+	return total;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::number_of_pinned_tasks(int worker_index) const noexcept -> int
+{
+	assert(worker_index >= 0 && worker_index < queue_count);
+	return pinned_inboxes[worker_index].size.load(std::memory_order_relaxed);
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::has_work_queued() const noexcept -> bool
+{
+	if (has_stealable_work_queued())
+		return true;
+	for (PinnedInbox const & inbox : pinned_inboxes)
+		if (inbox.size.load(std::memory_order_relaxed) > 0)
+			return true;
+	return false;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::has_stealable_work_queued() const noexcept -> bool
+{
+	for (PriorityBand const & b : bands)
+		for (WorkStealingDeque const & deque : b.queues)
+			if (!deque.looks_empty())
+				return true;
+	return false;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::has_local_work_queued() const noexcept -> bool
+{
+	auto const own_index = this_thread::worker_queue_index(*this);
+	if (!own_index)
+		return has_work_queued();
+
+	for (PriorityBand const & b : bands)
+		if (!b.queues[*own_index].looks_empty())
+			return true;
+	return pinned_inboxes[*own_index].size.load(std::memory_order_relaxed) > 0;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::pop_task_from(PriorityBand & b, int preferred_queue_index) -> std::optional<Task>
+{
+	// Only sweep again if some deque was too contended to tell whether it had any tasks.
+	bool contended = true;
+	while (contended)
+	{
+		contended = false;
+
+		// Newest task of our own deque first, then oldest tasks of everyone else.
+		std::optional<Task> task;
+		if (!b.queues[preferred_queue_index].looks_empty())
+			task = take_from(b.queues[preferred_queue_index], contended);
+		auto const & order = (*steal_orders.load(std::memory_order_acquire))[preferred_queue_index];
+		int const victim_count = static_cast<int>(order.size());
+		int const first_victim = pick_first_victim(b, order);
+		for (int i = 0; i < victim_count && !task; ++i)
+		{
+			auto & victim = b.queues[order[(first_victim + i) % victim_count]];
+			if (victim.looks_empty())
+				continue;
+			task = victim.steal(contended);
+			// Tasks in the overflow of a deque can't be stolen. Take them as the owner if possible.
+			if (!task && victim.has_overflow())
+				task = take_from(victim, contended);
+		}
+
+		if (task)
+			return task;
+	}
+	return std::nullopt;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::wait_for_work(Parker & parker) -> void
+{
+	auto const own_index = this_thread::worker_queue_index(*this);
+	{
+		auto const g = std::lock_guard(parked_threads_mutex);
+		parked_threads.push_back(ParkedThread{&parker, own_index});
+		parked_thread_count++;
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	bool const has_pinned_work = own_index && pinned_inboxes[*own_index].size > 0;
+	// Tasks pinned to other workers are no reason to stay awake.
+	if (!has_stealable_work_queued() && !has_pinned_work)
+		parker.park();
+
+	// We may have been woken up by someone else, or not have parked at all. In that case we are still
+	// in the list. If a pusher already removed us, it has unparked us, which at worst makes the next
+	// park return immediately.
+	auto const g = std::lock_guard(parked_threads_mutex);
+	auto const it = std::find_if(parked_threads.begin(), parked_threads.end(), [&parker](ParkedThread const & parked) { return parked.parker == &parker; });
+	if (it != parked_threads.end())
+	{
+		parked_threads.erase(it);
+		parked_thread_count--;
+	}
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::wake_parked_threads(int count) -> void
+{
+	// Unpark while holding the lock so that the parker can't leave wait_for_work and be destroyed
+	// in the meantime.
+	auto const g = std::lock_guard(parked_threads_mutex);
+	for (int i = 0; i < count && !parked_threads.empty(); ++i)
+	{
+		parked_threads.back().parker->unpark();
+		parked_threads.pop_back();
+		parked_thread_count--;
+	}
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::pick_first_victim(PriorityBand const & b, std::vector<int> const & order) const noexcept -> int
+{
+	int const victim_count = static_cast<int>(order.size());
+	if (steal_policy == StealPolicy::linear || victim_count < 2)
+		return 0;
+
+	int const first = ::detail::thread_local_random() % victim_count;
+	if (steal_policy == StealPolicy::random)
+		return first;
+
+	int const second = ::detail::thread_local_random() % victim_count;
+	return b.queues[order[second]].size() > b.queues[order[first]].size() ? second : first;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::take_from(WorkStealingDeque & deque, bool & contended) -> std::optional<Task>
+{
+	if (auto const g = atomic_flag_lock_guard(deque.owner_flag))
+		return deque.take();
+
+	contended = true;
+	return deque.steal(contended);
+}
+
+template <typename Task>
+BasicTaskQueue<Task>::WorkStealingDeque::WorkStealingDeque()
+	: ring(std::make_unique<Slot[]>(capacity))
+{}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::WorkStealingDeque::push(Task && task) -> void
+{
+	int64_t const b = bottom.load(std::memory_order_relaxed);
+	int64_t const t = top.load(std::memory_order_acquire);
+	Slot & slot = ring[b & (capacity - 1)];
+
+	// Once something has overflowed keep overflowing until the owner drains it, so that the
+	// overflow always holds the newest tasks.
+	if (!overflow.empty() || b - t >= capacity || slot.full.load(std::memory_order_acquire))
+	{
+		overflow.push_back(std::move(task));
+		overflow_size.store(static_cast<int>(overflow.size()), std::memory_order_relaxed);
+		return;
+	}
+
+	slot.task = std::move(task);
+	slot.full.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::WorkStealingDeque::size() const noexcept -> int
+{
+	int64_t const b = bottom.load(std::memory_order_relaxed);
+	int64_t const t = top.load(std::memory_order_relaxed);
+	return overflow_size.load(std::memory_order_relaxed) + static_cast<int>(std::max<int64_t>(b - t, 0));
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::WorkStealingDeque::looks_empty() const noexcept -> bool
+{
+	return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed)
+		&& overflow_size.load(std::memory_order_relaxed) == 0;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::WorkStealingDeque::take() -> std::optional<Task>
+{
+	if (!overflow.empty())
+	{
+		auto task = std::move(overflow.back());
+		overflow.pop_back();
+		overflow_size.store(static_cast<int>(overflow.size()), std::memory_order_relaxed);
+		return task;
+	}
+
+	int64_t const b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b) // Empty
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return std::nullopt;
+	}
+
+	if (t == b) // Last task. Race against thieves for it.
+	{
+		bool const won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		if (!won)
+			return std::nullopt;
+	}
+
+	Slot & slot = ring[b & (capacity - 1)];
+	auto task = std::move(slot.task);
+	slot.full.store(false, std::memory_order_relaxed);
+	return task;
+}
+
+template <typename Task>
+auto BasicTaskQueue<Task>::WorkStealingDeque::steal(bool & contended) -> std::optional<Task>
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t const b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return std::nullopt;
+
+	// Unlike the original algorithm, claim the slot before reading it, because tasks can't be
+	// speculatively copied out. The full flag keeps the owner from reusing it until we are done.
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		contended = true;
+		return std::nullopt;
+	}
+
+	Slot & slot = ring[t & (capacity - 1)];
+	auto task = std::move(slot.task);
+	slot.full.store(false, std::memory_order_release);
+	return task;
+}
+
+namespace this_thread
+{
+	template <typename Task>
+	auto perform_task_for(BasicTaskQueue<Task> & task_queue) -> bool
+	{
+		if (auto const own_index = worker_queue_index(task_queue))
+			return perform_task_for(task_queue, *own_index);
+		else
+			return perform_task_for(task_queue, ::detail::thread_local_random() % task_queue.number_of_queues());
+	}
+
+	template <typename Task>
+	auto perform_task_for(BasicTaskQueue<Task> & task_queue, int preferred_queue_index) -> bool
+	{
+		auto task = task_queue.pop_task(preferred_queue_index);
+		if (task)
+		{
+			// May be helping from inside a continuation. The task is unrelated to its chain.
+			auto const scope = ::detail::ChainPriorityScope(std::nullopt);
+			task->consume();
+			return true;
+		}
+		else return false;
+	}
+
+	template <typename Task>
+	auto work_until_no_tasks_left_for(BasicTaskQueue<Task> & task_queue) -> int
+	{
+		if (auto const own_index = worker_queue_index(task_queue))
+			return work_until_no_tasks_left_for(task_queue, *own_index);
+		else
+			return work_until_no_tasks_left_for(task_queue, ::detail::thread_local_random() % task_queue.number_of_queues());
+	}
+
+	template <typename Task>
+	auto work_until_no_tasks_left_for(BasicTaskQueue<Task> & task_queue, int preferred_queue_index) -> int
+	{
+		int tasks_done = 0;
+		while (true)
+		{
+			bool const work_done = perform_task_for(task_queue, preferred_queue_index);
+			if (work_done)
+				tasks_done++;
+			else
+				break;
+		}
+		return tasks_done;
+	}
+}
+
+//******************************************************************************
+
+template <typename Task>
+BasicWorkerThread<Task>::BasicWorkerThread(WorkSource work_source, IdleStrategy idle_strategy)
+	: thread(&BasicWorkerThread<Task>::worker_main, std::ref(state), std::move(work_source), std::move(idle_strategy))
+{
+	// Not sure if this is the best idea but thread creation is already rare 
+	// and expensive and it is a good idea to always hold the invariant of 
+	// (state != nullptr) <-> has a working thread.
+	while (!state)
+		std::this_thread::yield();
+}
+
+template <typename Task>
+BasicWorkerThread<Task>::BasicWorkerThread(BasicWorkerThread && other) noexcept
+	: state(std::exchange(other.state, nullptr))
+	, thread(std::move(other.thread))
+{}
+
+template <typename Task>
+BasicWorkerThread<Task> & BasicWorkerThread<Task>::operator = (BasicWorkerThread && other) noexcept
+{
+	join();
+	thread = std::move(other.thread);
+	state = std::exchange(other.state, nullptr);
+	return *this;
+}
+
+template <typename Task>
+BasicWorkerThread<Task>::~BasicWorkerThread()
+{
+	join();
+}
+
+template <typename Task>
+auto BasicWorkerThread<Task>::work_for(WorkSource source, IdleStrategy idle_strategy) -> void
+{
+	assert(state);
+	{
+		auto const g = std::lock_guard(state->work_source_mutex);
+		state->work_source = std::move(source);
+		state->idle_strategy = std::move(idle_strategy);
+		state->work_source_changed = true;
+	}
+	state->parker.unpark();
+}
+
+template <typename Task>
+auto BasicWorkerThread<Task>::join() -> void
+{
+	if (state)
+	{
+		state->stop_token = true;
+		state->parker.unpark();
+		thread.join();
+		state = nullptr;
+	}
+}
+
+namespace detail
+{
+	template <typename Task>
+	auto work(
+		std::atomic<bool> & stop_token, std::atomic<bool> & work_source_changed, Parker & parker,
+		typename BasicWorkerThread<Task>::WorkSource const & work_source, IdleStrategy const & idle_strategy) -> void
+	{
+		// One task at a time. Tasks that haven't started yet stay in the queue, where other threads can
+		// steal them, a thread waiting on them can run them and higher priority tasks can overtake them.
+		Task task;
+		int idle_spins = 0;
+		while (!work_source_changed)
+		{
+			if (work_source(std::span(&task, 1)) > 0)
+			{
+				task.consume();
+				idle_spins = 0;
+			}
+			else if (stop_token)
+				break;
+			else if (idle_spins < idle_strategy.spin_budget || !idle_strategy.park)
+			{
+				idle_spins++;
+				std::this_thread::yield();
+			}
+			else
+			{
+				// join and work_for unpark us, so this can't miss a stop or a change of work source.
+				idle_strategy.park(parker);
+				idle_spins = 0;
+			}
+		}
+	}
+} // namespace detail
+
+template <typename Task>
+auto BasicWorkerThread<Task>::worker_main(WorkerState * & state_ptr, WorkSource initial_work_source, IdleStrategy initial_idle_strategy) -> void
+{
+	WorkerState thread_state;
+	thread_state.work_source = std::move(initial_work_source);
+	thread_state.idle_strategy = std::move(initial_idle_strategy);
+	state_ptr = &thread_state;
+
+	while (true)
+	{
+		if (thread_state.stop_token && !thread_state.work_source_changed)
+			break;
+
+		WorkSource current_work_source;
+		IdleStrategy current_idle_strategy;
+		{
+			auto const g = std::lock_guard(thread_state.work_source_mutex);
+			current_work_source = thread_state.work_source;
+			current_idle_strategy = thread_state.idle_strategy;
+			thread_state.work_source_changed = false;
+		}
+		detail::work<Task>(thread_state.stop_token, thread_state.work_source_changed, thread_state.parker, current_work_source, current_idle_strategy);
+		// The next work source may be for another queue, or for none.
+		this_thread::unregister_as_worker();
+	}
+}
+
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & task_queue) -> std::vector<BasicWorkerThread<Task>>
+{
+	return make_workers_for_queue(task_queue, task_queue.number_of_queues());
+}
+
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & queue, int worker_count) -> std::vector<BasicWorkerThread<Task>>
+{
+	return make_workers_for_queue(queue, worker_count, default_idle_spin_budget);
+}
+
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & queue, int worker_count, int idle_spin_budget) -> std::vector<BasicWorkerThread<Task>>
+{
+	std::vector<BasicWorkerThread<Task>> workers;
+	workers.reserve(worker_count);
+	for (int i = 0; i < worker_count; ++i)
+		workers.emplace_back(as_work_source(queue, i), as_idle_strategy(queue, idle_spin_budget));
+	return workers;
+}
+
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & queue, CpuTopology const & topology) -> std::vector<BasicWorkerThread<Task>>
+{
+	return make_workers_for_queue(queue, topology, static_cast<int>(topology.cpus.size()));
+}
+
+template <typename Task>
+auto make_workers_for_queue(BasicTaskQueue<Task> & queue, CpuTopology const & topology, int worker_count) -> std::vector<BasicWorkerThread<Task>>
+{
+	int const cpu_count = static_cast<int>(topology.cpus.size());
+	if (cpu_count == 0)
+		return make_workers_for_queue(queue, worker_count);
+
+	queue.set_steal_orders(make_steal_orders(topology, queue.number_of_queues()));
+
+	auto workers = make_workers_for_queue(queue, worker_count);
+	bool all_pinned = true;
+	for (int i = 0; i < worker_count; ++i)
+		all_pinned = workers[i].pin_to_cpu(topology.cpus[i % cpu_count].id) && all_pinned;
+
+	// Without every worker on its CPU, stealing by distance would be going by made up distances.
+	if (!all_pinned)
+		queue.set_steal_orders(make_rotation_steal_orders(queue.number_of_queues()));
+	return workers;
+}
+
+template <typename Task>
+auto assign_thread_pool_to_workers(std::type_identity_t<std::span<BasicWorkerThread<Task>>> workers, BasicTaskQueue<Task> & task_queue) -> void
+{
+	int const n = static_cast<int>(workers.size());
+	for (int i = 0; i < n; ++i)
+		workers[i].work_for(as_work_source(task_queue, i), as_idle_strategy(task_queue));
+}
@@ -0,0 +1,186 @@
+#include "timer_queue.hh"
+#include <algorithm>
+
+namespace
+{
+	template <typename Timer>
+	auto is_due_before(Timer const & a, Timer const & b) noexcept -> bool
+	{
+		return a.due < b.due || (a.due == b.due && a.id < b.id);
+	}
+}
+
+TimerQueue::TimerQueue(TaskQueue & target_)
+	: target(target_)
+	, timer_thread(&TimerQueue::timer_thread_main, this)
+{}
+
+TimerQueue::~TimerQueue()
+{
+	{
+		auto const g = std::lock_guard(mutex);
+		stop_requested = true;
+	}
+	timers_changed.notify_one();
+	timer_thread.join();
+}
+
+auto TimerQueue::run_task_at(PolymorphicTask task, Clock::time_point time) -> TimerId
+{
+	return add_timer(Timer{time, 0, std::move(task), Clock::duration::zero(), nullptr});
+}
+
+auto TimerQueue::run_task_after(PolymorphicTask task, Clock::duration delay) -> TimerId
+{
+	return run_task_at(std::move(task), Clock::now() + delay);
+}
+
+auto TimerQueue::run_periodic(std::function<void()> f, Clock::duration period) -> TimerId
+{
+	return add_timer(Timer{Clock::now() + period, 0, PolymorphicTask(), period, std::make_shared<std::function<void()>>(std::move(f))});
+}
+
+auto TimerQueue::cancel(TimerId id) -> bool
+{
+	Timer cancelled;
+	{
+		auto const g = std::lock_guard(mutex);
+		auto const it = positions.find(id);
+		if (it == positions.end())
+			return false;
+		cancelled = remove_timer_at(it->second);
+	}
+	// The task is destroyed here, out of the lock. The timer thread doesn't need to know, at worst it
+	// wakes up for nothing.
+	return true;
+}
+
+auto TimerQueue::number_of_pending_timers() const noexcept -> int
+{
+	auto const g = std::lock_guard(mutex);
+	return static_cast<int>(timers.size());
+}
+
+auto TimerQueue::add_timer(Timer timer) -> TimerId
+{
+	bool is_next;
+	TimerId id;
+	{
+		auto const g = std::lock_guard(mutex);
+		id = next_id++;
+		timer.id = id;
+		is_next = timers.empty() || timer.due < timers.front().due;
+		push_timer(std::move(timer));
+	}
+	// Only the timer thread cares, and only if it has to wake up earlier than it planned to.
+	if (is_next)
+		timers_changed.notify_one();
+	return id;
+}
+
+auto TimerQueue::timer_thread_main() -> void
+{
+	std::vector<PolymorphicTask> due_tasks;
+	auto lock = std::unique_lock(mutex);
+	while (!stop_requested)
+	{
+		if (timers.empty())
+		{
+			timers_changed.wait(lock);
+			continue;
+		}
+
+		auto const now = Clock::now();
+		if (timers.front().due > now)
+		{
+			auto const next_due = timers.front().due;
+			timers_changed.wait_until(lock, next_due);
+			continue;
+		}
+
+		while (!timers.empty() && timers.front().due <= now)
+		{
+			Timer timer = remove_timer_at(0);
+			if (timer.periodic_function)
+			{
+				due_tasks.push_back([f = timer.periodic_function]() { (*f)(); });
+				timer.due += timer.period;
+				if (timer.due <= now)
+					timer.due = now + timer.period;
+				push_timer(std::move(timer));
+			}
+			else
+				due_tasks.push_back(std::move(timer.task));
+		}
+
+		// Don't hold the lock while pushing, which may have to wake workers.
+		lock.unlock();
+		if (!due_tasks.empty())
+			target.push_tasks(due_tasks);
+		due_tasks.clear();
+		lock.lock();
+	}
+}
+
+auto TimerQueue::push_timer(Timer timer) -> void
+{
+	timers.emplace_back();
+	place_timer(timers.size() - 1, std::move(timer));
+	sift_up(timers.size() - 1);
+}
+
+auto TimerQueue::remove_timer_at(size_t index) -> Timer
+{
+	Timer removed = std::move(timers[index]);
+	positions.erase(removed.id);
+
+	size_t const last = timers.size() - 1;
+	if (index != last)
+	{
+		place_timer(index, std::move(timers[last]));
+		timers.pop_back();
+		sift_up(index);
+		sift_down(index);
+	}
+	else
+		timers.pop_back();
+	return removed;
+}
+
+auto TimerQueue::sift_up(size_t index) -> void
+{
+	while (index > 0)
+	{
+		size_t const parent = (index - 1) / 2;
+		if (!is_due_before(timers[index], timers[parent]))
+			break;
+		Timer moving = std::move(timers[index]);
+		place_timer(index, std::move(timers[parent]));
+		place_timer(parent, std::move(moving));
+		index = parent;
+	}
+}
+
+auto TimerQueue::sift_down(size_t index) -> void
+{
+	size_t const size = timers.size();
+	while (true)
+	{
+		size_t first = index;
+		for (size_t child = 2 * index + 1; child <= 2 * index + 2 && child < size; ++child)
+			if (is_due_before(timers[child], timers[first]))
+				first = child;
+		if (first == index)
+			break;
+		Timer moving = std::move(timers[index]);
+		place_timer(index, std::move(timers[first]));
+		place_timer(first, std::move(moving));
+		index = first;
+	}
+}
+
+auto TimerQueue::place_timer(size_t index, Timer timer) -> void
+{
+	positions[timer.id] = index;
+	timers[index] = std::move(timer);
+}
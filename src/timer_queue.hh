@@ -0,0 +1,73 @@
+#pragma once
+
+#include "thread_pool.hh"
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+
+// Holds tasks until a point in time and then pushes them to a task queue. A single thread sleeps
+// until the next timer is due, so waiting doesn't take a worker. Tasks that become due together are
+// pushed as a batch.
+struct TimerQueue
+{
+	using Clock = std::chrono::steady_clock;
+	using TimerId = uint64_t;
+
+	explicit TimerQueue(TaskQueue & target);
+	~TimerQueue();
+
+	TimerQueue(TimerQueue const &) = delete;
+	TimerQueue & operator = (TimerQueue const &) = delete;
+
+	auto run_task_at(PolymorphicTask task, Clock::time_point time) -> TimerId;
+	auto run_task_after(PolymorphicTask task, Clock::duration delay) -> TimerId;
+	// Pushes a call to f every period, starting one period from now. Runs don't wait for the
+	// previous one to finish, so f may run concurrently with itself if it takes longer than a period.
+	// If the timer thread falls behind, missed ticks are skipped instead of being pushed all at once.
+	auto run_periodic(std::function<void()> f, Clock::duration period) -> TimerId;
+
+	// Returns false if the timer already fired, or was already cancelled. Periodic timers can always
+	// be cancelled. The timer and its task are destroyed right away, before this returns. A task that
+	// has already been pushed to the target queue will still run.
+	auto cancel(TimerId id) -> bool;
+
+	// To make it satisfy the executor concepts. Not delayed, it goes straight to the target queue.
+	auto run_task(PolymorphicTask task) -> void { target.push_task(std::move(task)); }
+	auto run_task(PolymorphicTask task, TaskPriority priority) -> void { target.push_task(std::move(task), priority); }
+
+	auto number_of_pending_timers() const noexcept -> int;
+
+private:
+	struct Timer
+	{
+		Clock::time_point due;
+		TimerId id;
+		PolymorphicTask task;
+		// Only for periodic timers, which push a new task that calls it on every tick.
+		Clock::duration period;
+		std::shared_ptr<std::function<void()>> periodic_function;
+	};
+
+	auto add_timer(Timer timer) -> TimerId;
+	auto timer_thread_main() -> void;
+
+	// Heap operations that keep positions up to date. Must hold the mutex.
+	auto push_timer(Timer timer) -> void;
+	auto remove_timer_at(size_t index) -> Timer;
+	auto sift_up(size_t index) -> void;
+	auto sift_down(size_t index) -> void;
+	auto place_timer(size_t index, Timer timer) -> void;
+
+	TaskQueue & target;
+
+	mutable std::mutex mutex;
+	std::condition_variable timers_changed;
+	// Min heap on due time. Indexed by id, so that a cancelled timer can be taken out right away
+	// instead of staying there with its task until it is due.
+	std::vector<Timer> timers;
+	std::unordered_map<TimerId, size_t> positions;
+	TimerId next_id = 0;
+	bool stop_requested = false;
+
+	std::thread timer_thread;
+};
@@ -0,0 +1,236 @@
+#include "topology.hh"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <tuple>
+
+#if defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+	#include <optional>
+#elif defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#endif
+
+auto distance(LogicalCpu const & a, LogicalCpu const & b) noexcept -> CpuDistance
+{
+	if (a.id == b.id)
+		return CpuDistance::same_cpu;
+	else if (a.core == b.core)
+		return CpuDistance::smt_sibling;
+	else if (a.l3_cache == b.l3_cache)
+		return CpuDistance::shared_l3_cache;
+	else if (a.numa_node == b.numa_node)
+		return CpuDistance::same_numa_node;
+	else
+		return CpuDistance::remote_numa_node;
+}
+
+CpuTopology::CpuTopology(std::vector<LogicalCpu> cpus_)
+	: cpus(std::move(cpus_))
+{
+	std::sort(cpus.begin(), cpus.end(), [](LogicalCpu const & a, LogicalCpu const & b)
+	{
+		return std::tie(a.numa_node, a.l3_cache, a.core, a.id) < std::tie(b.numa_node, b.l3_cache, b.core, b.id);
+	});
+}
+
+namespace
+{
+	// Whether the process may run on the CPU. The scheduler already applies the cpuset of the
+	// container, if any, to this mask.
+	auto is_cpu_allowed(int id) -> bool
+	{
+#if defined(__linux__)
+		static std::optional<cpu_set_t> const allowed = []() -> std::optional<cpu_set_t>
+		{
+			cpu_set_t cpu_set;
+			CPU_ZERO(&cpu_set);
+			if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+				return std::nullopt;
+			return cpu_set;
+		}();
+		return !allowed || (id >= 0 && id < CPU_SETSIZE && CPU_ISSET(id, &*allowed));
+#elif defined(_WIN32)
+		DWORD_PTR process_mask = 0;
+		DWORD_PTR system_mask = 0;
+		if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+			return true;
+		return id >= 0 && id < static_cast<int>(sizeof(DWORD_PTR) * 8) && (process_mask & (DWORD_PTR(1) << id)) != 0;
+#else
+		(void)id;
+		return true;
+#endif
+	}
+
+	auto flat_topology() -> CpuTopology
+	{
+		int const cpu_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		std::vector<LogicalCpu> cpus;
+		cpus.reserve(cpu_count);
+		for (int i = 0; i < cpu_count; ++i)
+			if (is_cpu_allowed(i))
+				cpus.push_back(LogicalCpu{i, i, 0, 0});
+		// If the mask doesn't make sense, better to have some topology than none.
+		if (cpus.empty())
+			for (int i = 0; i < cpu_count; ++i)
+				cpus.push_back(LogicalCpu{i, i, 0, 0});
+		return CpuTopology(std::move(cpus));
+	}
+
+#if defined(__linux__)
+	namespace fs = std::filesystem;
+
+	auto read_first_line(fs::path const & path) -> std::string
+	{
+		std::ifstream file(path);
+		std::string line;
+		std::getline(file, line);
+		return line;
+	}
+
+	// Parses the list format of sysfs, such as "0-3,8,10-11".
+	auto parse_cpu_list(std::string const & list) -> std::vector<int>
+	{
+		std::vector<int> cpus;
+		size_t position = 0;
+		while (position < list.size())
+		{
+			size_t const end = std::min(list.find(',', position), list.size());
+			std::string const range = list.substr(position, end - position);
+			size_t const dash = range.find('-');
+			try
+			{
+				int const first = std::stoi(range.substr(0, dash));
+				int const last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+				for (int cpu = first; cpu <= last; ++cpu)
+					cpus.push_back(cpu);
+			}
+			catch (std::exception const &) {}
+			position = end + 1;
+		}
+		return cpus;
+	}
+
+	// Lowest CPU of a list of CPUs, which makes for an id of the group that is unique in the machine.
+	auto group_id(fs::path const & cpu_list_path, int fallback) -> int
+	{
+		auto const cpus = parse_cpu_list(read_first_line(cpu_list_path));
+		return cpus.empty() ? fallback : *std::min_element(cpus.begin(), cpus.end());
+	}
+
+	auto read_logical_cpu(fs::path const & cpu_directory, int id) -> LogicalCpu
+	{
+		LogicalCpu cpu{id, id, 0, 0};
+		cpu.core = group_id(cpu_directory / "topology" / "thread_siblings_list", id);
+
+		// Without an L3 cache, CPUs of the same package are treated as sharing one.
+		cpu.l3_cache = -1;
+		std::error_code error;
+		for (auto const & cache : fs::directory_iterator(cpu_directory / "cache", error))
+		{
+			if (cache.path().filename().string().starts_with("index") && read_first_line(cache.path() / "level") == "3")
+				cpu.l3_cache = group_id(cache.path() / "shared_cpu_list", id);
+		}
+		if (cpu.l3_cache == -1)
+		{
+			try { cpu.l3_cache = -1 - std::stoi(read_first_line(cpu_directory / "topology" / "physical_package_id")); }
+			catch (std::exception const &) { cpu.l3_cache = 0; }
+		}
+
+		for (auto const & entry : fs::directory_iterator(cpu_directory, error))
+		{
+			std::string const name = entry.path().filename().string();
+			if (name.starts_with("node"))
+			{
+				try { cpu.numa_node = std::stoi(name.substr(4)); }
+				catch (std::exception const &) {}
+			}
+		}
+
+		return cpu;
+	}
+
+	auto read_topology() -> std::vector<LogicalCpu>
+	{
+		fs::path const root = "/sys/devices/system/cpu";
+		std::vector<LogicalCpu> cpus;
+		for (int id : parse_cpu_list(read_first_line(root / "online")))
+		{
+			fs::path const cpu_directory = root / ("cpu" + std::to_string(id));
+			if (is_cpu_allowed(id) && fs::exists(cpu_directory))
+				cpus.push_back(read_logical_cpu(cpu_directory, id));
+		}
+		return cpus;
+	}
+#endif
+} // namespace
+
+auto CpuTopology::detect() -> CpuTopology
+{
+#if defined(__linux__)
+	auto cpus = read_topology();
+	if (!cpus.empty())
+		return CpuTopology(std::move(cpus));
+#endif
+	return flat_topology();
+}
+
+auto make_steal_orders(CpuTopology const & topology, int queue_count) -> std::vector<std::vector<int>>
+{
+	int const cpu_count = static_cast<int>(topology.cpus.size());
+	if (cpu_count == 0)
+		return make_rotation_steal_orders(queue_count);
+	auto const cpu_of_queue = [&](int queue) -> LogicalCpu const & { return topology.cpus[queue % cpu_count]; };
+
+	std::vector<std::vector<int>> orders(queue_count);
+	for (int queue = 0; queue < queue_count; ++queue)
+	{
+		std::vector<int> & order = orders[queue];
+		order.reserve(queue_count - 1);
+		for (int i = 1; i < queue_count; ++i)
+			order.push_back((queue + i) % queue_count);
+
+		// Stable sort keeps victims at the same distance in round robin order starting from the next queue.
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+		{
+			return distance(cpu_of_queue(queue), cpu_of_queue(a)) < distance(cpu_of_queue(queue), cpu_of_queue(b));
+		});
+	}
+	return orders;
+}
+
+auto make_rotation_steal_orders(int queue_count) -> std::vector<std::vector<int>>
+{
+	std::vector<std::vector<int>> orders(queue_count);
+	for (int queue = 0; queue < queue_count; ++queue)
+	{
+		orders[queue].reserve(queue_count - 1);
+		for (int i = 1; i < queue_count; ++i)
+			orders[queue].push_back((queue + i) % queue_count);
+	}
+	return orders;
+}
+
+auto pin_thread_to_cpu(std::thread & thread, int cpu_id) -> bool
+{
+#if defined(__linux__)
+	if (cpu_id < 0 || cpu_id >= CPU_SETSIZE)
+		return false;
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu_id, &cpu_set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set) == 0;
+#elif defined(_WIN32)
+	if (cpu_id < 0 || cpu_id >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+		return false;
+	return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu_id) != 0;
+#else
+	(void)thread;
+	(void)cpu_id;
+	return false;
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+
+// Where a logical CPU sits in the memory hierarchy of the machine. Ids of cores, caches and nodes
+// are only meaningful when compared against each other.
+struct LogicalCpu
+{
+	int id;
+	int core;
+	int l3_cache;
+	int numa_node;
+
+	[[nodiscard]] auto operator == (LogicalCpu const & other) const noexcept -> bool = default;
+};
+
+enum class CpuDistance { same_cpu, smt_sibling, shared_l3_cache, same_numa_node, remote_numa_node };
+
+[[nodiscard]] auto distance(LogicalCpu const & a, LogicalCpu const & b) noexcept -> CpuDistance;
+
+struct CpuTopology
+{
+	// Reads the topology from /sys/devices/system/cpu on Linux. Elsewhere, or if it can't be read,
+	// every CPU the standard library reports is treated as its own core, all of them sharing a
+	// cache in a single node. Only CPUs in the affinity mask of the process are included, which in a
+	// container also accounts for its cpuset.
+	[[nodiscard]] static auto detect() -> CpuTopology;
+
+	// Sorted by node, then cache, then core, so that CPUs close to each other are next to each other.
+	explicit CpuTopology(std::vector<LogicalCpu> cpus_);
+
+	std::vector<LogicalCpu> cpus;
+};
+
+// For each of queue_count queues, the order in which it should steal from the others. Queue i is
+// assumed to be worked on by a thread pinned to topology.cpus[i % cpus.size()]. Victims go from
+// closest to farthest, and queues at the same distance are visited starting from the next one.
+// An empty topology gives the rotation order.
+[[nodiscard]] auto make_steal_orders(CpuTopology const & topology, int queue_count) -> std::vector<std::vector<int>>;
+// Each queue visits the others starting from the next one. The default of a task queue.
+[[nodiscard]] auto make_rotation_steal_orders(int queue_count) -> std::vector<std::vector<int>>;
+
+// Restricts a thread to run only on the given logical CPU. Returns false if it failed or if the
+// platform is not supported.
+auto pin_thread_to_cpu(std::thread & thread, int cpu_id) -> bool;
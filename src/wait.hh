@@ -0,0 +1,47 @@
+#pragma once
+
+#include "thread_pool.hh"
+#include "bounded_task_queue.hh"
+#include "future.hh"
+#include <future>
+#include <chrono>
+
+// Executor that a thread can run tasks of while it waits for something.
+template <typename E>
+concept is_helpable_task_executor = is_task_executor<E> && requires(E & executor) { this_thread::perform_task_for(executor); };
+
+// How long a helping wait on a std::future blocks on it when there are no tasks to run, before
+// looking at the executor again. std::future can't wake a thread that is parked on a task queue, so
+// this bounds how late a waiting thread notices new tasks.
+constexpr auto helping_wait_poll_interval = std::chrono::microseconds(100);
+
+namespace this_thread
+{
+	// Runs tasks of the executor until the future is ready and returns its result. Blocks only when the
+	// executor has nothing to run, so waiting on a worker thread doesn't take it away from the pool,
+	// and a task that the result depends on can't get stuck behind the waiting thread.
+	template <typename T, is_helpable_task_executor Executor>
+	auto wait_for(Future<T> & future, Executor & executor) -> T;
+	// Fallback for std::future, which can't unpark anyone. Instead of parking, it blocks on the future
+	// for helping_wait_poll_interval at a time and looks at the executor in between. Prefer Future.
+	template <typename T, is_helpable_task_executor Executor>
+	auto wait_for(std::future<T> & future, Executor & executor) -> T;
+}
+
+// A future and the executor that its result will come from. get runs tasks of the executor while it
+// waits instead of blocking the thread.
+template <typename T, is_helpable_task_executor Executor>
+struct HelpingFuture
+{
+	explicit HelpingFuture(Future<T> future_, Executor & executor_) noexcept : future(std::move(future_)), executor(std::addressof(executor_)) {}
+
+	auto get() -> T { return this_thread::wait_for(future, *executor); }
+	auto is_ready() const noexcept -> bool { return future.is_ready(); }
+	auto valid() const noexcept -> bool { return future.valid(); }
+
+private:
+	Future<T> future;
+	Executor * executor;
+};
+
+#include "wait.inl"
@@ -0,0 +1,30 @@
+namespace this_thread
+{
+	template <typename T, is_helpable_task_executor Executor>
+	auto wait_for(Future<T> & future, Executor & executor) -> T
+	{
+		while (!future.is_ready())
+		{
+			if (this_thread::perform_task_for(executor))
+				continue;
+
+			// Setting the result unparks the parker of the future, so this wakes up for either.
+			if constexpr (requires { executor.wait_for_work(future.parker()); })
+				executor.wait_for_work(future.parker());
+			else
+				std::this_thread::yield();
+		}
+		return future.get();
+	}
+
+	template <typename T, is_helpable_task_executor Executor>
+	auto wait_for(std::future<T> & future, Executor & executor) -> T
+	{
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			if (!this_thread::perform_task_for(executor))
+				future.wait_for(helping_wait_poll_interval);
+		}
+		return future.get();
+	}
+}
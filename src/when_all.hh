@@ -5,8 +5,25 @@
 #include <optional>
 #include <atomic>
 #include <memory>
+#include <span>
+#include <new>
+#include <vector>
 
 template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, result_type<ArgProducers>...>
 [[nodiscard]] auto when_all(F f, Executor & executor, ArgProducers ... arg_producers);
 
+// f is dropped if the token has been cancelled by the time the last producer finishes.
+template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, result_type<ArgProducers>...>
+[[nodiscard]] auto when_all(CancellationToken token, F f, Executor & executor, ArgProducers ... arg_producers);
+
+// For a number of producers only known at run time. f is called with the results of all of them, in
+// the same order as the producers. The results are stored next to each other in a buffer allocated
+// up front, so f can look at them through a span without them being moved. Producers are moved from.
+template <typename F, is_task_executor Executor, typename ArgProducer> requires std::invocable<F, std::span<result_type<ArgProducer>>>
+[[nodiscard]] auto when_all(F f, Executor & executor, std::span<ArgProducer> arg_producers);
+
+// f is dropped if the token has been cancelled by the time the last producer finishes.
+template <typename F, is_task_executor Executor, typename ArgProducer> requires std::invocable<F, std::span<result_type<ArgProducer>>>
+[[nodiscard]] auto when_all(CancellationToken token, F f, Executor & executor, std::span<ArgProducer> arg_producers);
+
 #include "when_all.inl"
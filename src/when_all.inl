@@ -1,23 +1,24 @@
 namespace detail
 {
 
-	template <is_task_executor Executor, typename F, typename ... Args> requires std::invocable<F, Args...>
+	template <is_task_executor Executor, typename F, typename RunTask, typename ... Args> requires std::invocable<F, Args...>
 	struct JointContinuation
 	{
-		explicit JointContinuation(Executor * executor_, F function_) noexcept
+		explicit JointContinuation(Executor * executor_, F function_, RunTask run_task_) noexcept
 			: executor(executor_)
 			, function(std::move(function_))
+			, run_task(std::move(run_task_))
 		{}
 
 		template <size_t N>
 		void set_value(std::integral_constant<size_t, N>, std::tuple_element_t<N, std::tuple<Args...>> value)
 		{
 			std::get<N>(args) = std::move(value);
-			if (++set_arguments == sizeof...(Args))
+			if (++set_arguments == sizeof...(Args) && !run_task.is_cancelled())
 			{
-				auto const helper = [executor_ = executor]<size_t ... Is>(F & f_, std::tuple<std::optional<Args>...> &args_, std::index_sequence<Is...>)
+				auto const helper = [this]<size_t ... Is>(F & f_, std::tuple<std::optional<Args>...> &args_, std::index_sequence<Is...>)
 				{
-					executor_->run_task(task(std::move(f_), std::move(*std::get<Is>(args_))...));
+					run_task(*executor, task(std::move(f_), std::move(*std::get<Is>(args_))...));
 				};
 				helper(function, args, std::make_index_sequence<sizeof...(Args)>());
 			}
@@ -26,6 +27,7 @@ namespace detail
 	private:
 		Executor * executor;
 		F function;
+		[[no_unique_address]] RunTask run_task;
 		std::tuple<std::optional<Args>...> args;
 		std::atomic<int> set_arguments = 0;
 	};
@@ -42,8 +44,8 @@ namespace detail
 		constexpr disable_copy & operator = (disable_copy &&) noexcept = default;
 	};
 
-	template <size_t N, is_task_executor Executor, typename F, typename ... Args>
-	auto set_value_continuation(std::shared_ptr<JointContinuation<Executor, F, Args...>> c)
+	template <size_t N, is_task_executor Executor, typename F, typename RunTask, typename ... Args>
+	auto set_value_continuation(std::shared_ptr<JointContinuation<Executor, F, RunTask, Args...>> c)
 	{
 		return[c_ = disable_copy(std::move(c))](std::tuple_element_t<N, std::tuple<Args...>> value)
 		{
@@ -51,25 +53,141 @@ namespace detail
 		};
 	}
 
+	// Joint continuation for any number of results of the same type. Results are constructed in place
+	// in a single buffer and counted down with one atomic. The producer that sets the last one pushes
+	// the task that calls f, which keeps the whole thing alive until it has run.
+	template <is_task_executor Executor, typename F, typename RunTask, typename Arg> requires std::invocable<F, std::span<Arg>>
+	struct DynamicJointContinuation : std::enable_shared_from_this<DynamicJointContinuation<Executor, F, RunTask, Arg>>
+	{
+		explicit DynamicJointContinuation(Executor * executor_, F function_, RunTask run_task_, size_t count_)
+			: executor(executor_)
+			, function(std::move(function_))
+			, run_task(std::move(run_task_))
+			, count(count_)
+			, values(static_cast<Arg *>(::operator new(count_ * sizeof(Arg), std::align_val_t(alignof(Arg)))))
+			, is_set(std::make_unique<bool[]>(count_))
+			, arguments_left(static_cast<int>(count_))
+		{}
+
+		~DynamicJointContinuation()
+		{
+			// A producer may never have run, so not every value has been constructed.
+			for (size_t i = 0; i < count; ++i)
+				if (is_set[i])
+					values[i].~Arg();
+			::operator delete(values, std::align_val_t(alignof(Arg)));
+		}
+
+		DynamicJointContinuation(DynamicJointContinuation const &) = delete;
+		DynamicJointContinuation & operator = (DynamicJointContinuation const &) = delete;
+
+		auto set_value(size_t index, Arg value) -> void
+		{
+			::new(values + index) Arg(std::move(value));
+			is_set[index] = true;
+			if (arguments_left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				schedule();
+		}
+
+		// Fills slots in the order results arrive rather than one per producer. Results that arrive
+		// once every slot is taken are dropped.
+		auto set_next_value(Arg value) -> void
+		{
+			size_t const index = next_index.fetch_add(1, std::memory_order_relaxed);
+			if (index < count)
+				set_value(index, std::move(value));
+		}
+
+		auto schedule() -> void
+		{
+			if (!run_task.is_cancelled())
+				run_task(*executor, [self = this->shared_from_this()]() { std::invoke(std::move(self->function), std::span<Arg>(self->values, self->count)); });
+		}
+
+	private:
+		Executor * executor;
+		F function;
+		[[no_unique_address]] RunTask run_task;
+		size_t count;
+		Arg * values;
+		std::unique_ptr<bool[]> is_set;
+		std::atomic<int> arguments_left;
+		std::atomic<size_t> next_index = 0;
+	};
+
+	template <is_task_executor Executor, typename F, typename RunTask, typename ArgProducer>
+	auto make_dynamic_when_all(Executor & executor, RunTask run_task, F f, std::span<ArgProducer> arg_producers)
+	{
+		using Arg = result_type<ArgProducer>;
+		using joint_continuation_t = DynamicJointContinuation<Executor, F, RunTask, Arg>;
+		auto joint_continuation = std::make_shared<joint_continuation_t>(std::addressof(executor), std::move(f), std::move(run_task), arg_producers.size());
+
+		auto const set_value_continuation = [&joint_continuation](size_t index)
+		{
+			return [c_ = disable_copy(joint_continuation), index](Arg value)
+			{
+				c_->set_value(index, std::move(value));
+			};
+		};
+
+		std::vector<decltype(std::move(arg_producers[0]).then(set_value_continuation(0)))> producers;
+		producers.reserve(arg_producers.size());
+		for (size_t i = 0; i < arg_producers.size(); ++i)
+			producers.push_back(std::move(arg_producers[i]).then(set_value_continuation(i)));
+
+		// Nothing to wait for.
+		if (arg_producers.empty())
+			joint_continuation->schedule();
+
+		return producers;
+	}
+
+	template <is_task_executor Executor, typename F, typename RunTask, typename ... ArgProducers>
+	auto make_when_all(Executor & executor, RunTask run_task, F f, ArgProducers ... arg_producers)
+	{
+		using joint_continuation_t = JointContinuation<Executor, F, RunTask, result_type<ArgProducers>...>;
+		auto joint_continuation = std::make_shared<joint_continuation_t>(std::addressof(executor), std::move(f), std::move(run_task));
+
+		auto const helper = []<size_t ... Is>(
+			std::index_sequence<Is...>,
+			std::shared_ptr<joint_continuation_t> c,
+			std::tuple<ArgProducers...> p)
+		{
+			return std::make_tuple(
+				std::move(std::get<Is>(p)).then(set_value_continuation<Is>(c))...
+			);
+		};
+		return helper(
+			std::make_index_sequence<sizeof...(ArgProducers)>(),
+			std::move(joint_continuation),
+			std::make_tuple(std::move(arg_producers)...)
+		);
+	}
+
 } // namespace detail
 
 template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, result_type<ArgProducers>...>
 auto when_all(F f, Executor & executor, ArgProducers ... arg_producers)
 {
-	auto joint_continuation = std::make_shared<detail::JointContinuation<Executor, F, result_type<ArgProducers>...>>(std::addressof(executor), std::move(f));
+	return detail::make_when_all(executor, detail::run_task_normally(), std::move(f), std::move(arg_producers)...);
+}
 
-	auto const helper = []<size_t ... Is>(
-		std::index_sequence<Is...>,
-		std::shared_ptr<detail::JointContinuation<Executor, F, result_type<ArgProducers>...>> c,
-		std::tuple<ArgProducers...> p)
-	{
-		return std::make_tuple(
-			std::move(std::get<Is>(p)).then(detail::set_value_continuation<Is>(c))...
-		);
-	};
-	return helper(
-		std::make_index_sequence<sizeof...(ArgProducers)>(),
-		std::move(joint_continuation),
-		std::make_tuple(std::move(arg_producers)...)
-	);
-}
\ No newline at end of file
+template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, result_type<ArgProducers>...>
+auto when_all(CancellationToken token, F f, Executor & executor, ArgProducers ... arg_producers)
+{
+	auto run_task = detail::run_task_unless_cancelled<detail::run_task_normally>{detail::run_task_normally(), std::move(token)};
+	return detail::make_when_all(executor, std::move(run_task), std::move(f), std::move(arg_producers)...);
+}
+
+template <typename F, is_task_executor Executor, typename ArgProducer> requires std::invocable<F, std::span<result_type<ArgProducer>>>
+auto when_all(F f, Executor & executor, std::span<ArgProducer> arg_producers)
+{
+	return detail::make_dynamic_when_all(executor, detail::run_task_normally(), std::move(f), arg_producers);
+}
+
+template <typename F, is_task_executor Executor, typename ArgProducer> requires std::invocable<F, std::span<result_type<ArgProducer>>>
+auto when_all(CancellationToken token, F f, Executor & executor, std::span<ArgProducer> arg_producers)
+{
+	auto run_task = detail::run_task_unless_cancelled<detail::run_task_normally>{detail::run_task_normally(), std::move(token)};
+	return detail::make_dynamic_when_all(executor, std::move(run_task), std::move(f), arg_producers);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "when_all.hh"
+#include <type_traits>
+
+// f is called with the result of whichever producer finishes first. The results of the others are
+// dropped as they arrive. Producers must produce a common type.
+template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, std::common_type_t<result_type<ArgProducers>...>>
+[[nodiscard]] auto when_any(F f, Executor & executor, ArgProducers ... arg_producers);
+
+// f is called with the results of the first n producers to finish, in the order they finished. n
+// can't be more than the number of producers.
+template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, std::span<std::common_type_t<result_type<ArgProducers>...>>>
+[[nodiscard]] auto when_n(size_t n, F f, Executor & executor, ArgProducers ... arg_producers);
+
+#include "when_any.inl"
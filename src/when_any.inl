@@ -0,0 +1,46 @@
+#include <cassert>
+
+namespace detail
+{
+	template <is_task_executor Executor, typename F, typename ... ArgProducers>
+	auto make_when_n(Executor & executor, size_t n, F f, ArgProducers ... arg_producers)
+	{
+		assert(n <= sizeof...(ArgProducers));
+
+		using Arg = std::common_type_t<result_type<ArgProducers>...>;
+		using joint_continuation_t = DynamicJointContinuation<Executor, F, run_task_normally, Arg>;
+		auto joint_continuation = std::make_shared<joint_continuation_t>(std::addressof(executor), std::move(f), run_task_normally(), n);
+
+		// Nothing to wait for.
+		if (n == 0)
+			joint_continuation->schedule();
+
+		auto const set_next_value_continuation = [&joint_continuation]()
+		{
+			return [c_ = disable_copy(joint_continuation)](Arg value)
+			{
+				c_->set_next_value(std::move(value));
+			};
+		};
+		return std::make_tuple(std::move(arg_producers).then(set_next_value_continuation())...);
+	}
+} // namespace detail
+
+template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, std::common_type_t<result_type<ArgProducers>...>>
+auto when_any(F f, Executor & executor, ArgProducers ... arg_producers)
+{
+	static_assert(sizeof...(ArgProducers) > 0, "when_any needs at least one producer.");
+
+	using Arg = std::common_type_t<result_type<ArgProducers>...>;
+	auto call_with_first = [f_ = std::move(f)](std::span<Arg> values) mutable
+	{
+		return std::invoke(std::move(f_), std::move(values[0]));
+	};
+	return detail::make_when_n(executor, 1, std::move(call_with_first), std::move(arg_producers)...);
+}
+
+template <typename F, is_task_executor Executor, typename ... ArgProducers> requires std::invocable<F, std::span<std::common_type_t<result_type<ArgProducers>...>>>
+auto when_n(size_t n, F f, Executor & executor, ArgProducers ... arg_producers)
+{
+	return detail::make_when_n(executor, n, std::move(f), std::move(arg_producers)...);
+}